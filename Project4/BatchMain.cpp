@@ -0,0 +1,210 @@
+// BatchMain.cpp
+
+// Plans many delivery files against one map.  The map is loaded once and shared read-only by
+// every job, and the jobs run concurrently on the shared thread pool.  Build it instead of
+// main.cpp:
+//
+//     BatchMain mapdata.txt jobs [outputDirectory]
+//
+// jobs is either a manifest listing one deliveries file per line or a directory whose files
+// are all deliveries files.  With an output directory each job's plan is written there as
+// <deliveries file name>.out, in the format main.cpp prints; without one only the per-job
+// lines and the summary are printed.
+
+#include "provided.h"
+#include "DeliveryIO.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <dirent.h>
+#include <sys/stat.h>
+using namespace std;
+
+struct BatchJob
+{
+    string         deliveriesFile;
+    bool           loaded;
+    DeliveryResult result;
+    int            numDeliveries;
+    double         totalMiles;
+    double         seconds;      // loading the file through formatting the plan
+    string         output;       // the plan as main.cpp would print it
+};
+
+static bool isDirectory(const string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// every regular file in the directory, sorted so runs are repeatable
+static bool listDirectory(const string& directory, vector<string>& files)
+{
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        return false;
+    for (dirent* entry = readdir(dir); entry; entry = readdir(dir))
+    {
+        string path = directory + "/" + entry->d_name;
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+            files.push_back(path);
+    }
+    closedir(dir);
+    sort(files.begin(), files.end());
+    return true;
+}
+
+static bool readManifest(const string& manifest, vector<string>& files)
+{
+    ifstream inf(manifest);
+    if (!inf)
+        return false;
+    string line;
+    while (getline(inf, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (!line.empty())
+            files.push_back(line);
+    }
+    return true;
+}
+
+static string baseName(const string& path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+static void runJob(const DeliveryPlanner& planner, BatchJob& job)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    GeoCoord depot;
+    vector<DeliveryRequest> deliveries;
+    ostringstream out;   // complaints about lines that didn't parse
+    ifstream inf(job.deliveriesFile);
+    job.loaded = bool(inf);
+    job.totalMiles = 0;
+    if (job.loaded)
+    {
+        // coordinates that aren't numbers fail only this job, as BAD_COORD
+        bool valid = readDeliveryRequests(inf, depot, deliveries, out);
+        job.numDeliveries = deliveries.size();
+        vector<DeliveryCommand> commands;
+        job.result = valid ? planner.generateDeliveryPlan(depot, deliveries, commands, job.totalMiles) : BAD_COORD;
+        job.output = out.str();
+        formatDeliveryPlan(job.output, job.result, commands, job.totalMiles);
+    }
+    else
+    {
+        job.numDeliveries = 0;
+        job.output = "Unable to load delivery request file " + job.deliveriesFile + "\n";
+    }
+    job.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static const char* resultName(const BatchJob& job)
+{
+    if (!job.loaded)
+        return "UNREADABLE";
+    switch (job.result)
+    {
+        case DELIVERY_SUCCESS: return "OK";
+        case NO_ROUTE:         return "NO_ROUTE";
+        case BAD_COORD:        return "BAD_COORD";
+        case OVER_CAPACITY:    return "OVER_CAPACITY";
+    }
+    return "?";
+}
+
+// the latency below which the given fraction of jobs finished
+static double percentile(vector<double> seconds, double fraction)
+{
+    sort(seconds.begin(), seconds.end());
+    int index = min<int>(seconds.size() - 1, fraction * seconds.size());
+    return seconds[index];
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3 && argc != 4)
+    {
+        cout << "Usage: " << argv[0] << " mapdata.txt manifest-or-directory [outputDirectory]" << endl;
+        return 1;
+    }
+
+    StreetMap sm;
+    chrono::steady_clock::time_point loadStart = chrono::steady_clock::now();
+    if (!sm.load(argv[1]))
+    {
+        cout << "Unable to load map data file " << argv[1] << endl;
+        return 1;
+    }
+    double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+
+    vector<string> files;
+    bool listed = isDirectory(argv[2]) ? listDirectory(argv[2], files) : readManifest(argv[2], files);
+    if (!listed)
+    {
+        cout << "Unable to read job list " << argv[2] << endl;
+        return 1;
+    }
+    if (files.empty())
+    {
+        cout << "No jobs in " << argv[2] << endl;
+        return 1;
+    }
+
+    vector<BatchJob> jobs(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+        jobs[i].deliveriesFile = files[i];
+
+    // one planner for every job: planning only reads the planner and the map
+    DeliveryPlanner planner(&sm);
+    chrono::steady_clock::time_point batchStart = chrono::steady_clock::now();
+    {
+        TaskGroup group(ThreadPool::shared());
+        for (size_t i = 0; i < jobs.size(); i++)
+            group.run([&planner, &jobs, i]() { runJob(planner, jobs[i]); });
+    }
+    double batchSeconds = chrono::duration<double>(chrono::steady_clock::now() - batchStart).count();
+
+    int failed = 0;
+    vector<double> latencies;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const BatchJob& job = jobs[i];
+        if (!job.loaded || job.result != DELIVERY_SUCCESS)
+            failed++;
+        latencies.push_back(job.seconds);
+        cout << job.deliveriesFile << " " << resultName(job) << " " << job.numDeliveries << " deliveries "
+             << fixed << setprecision(2) << job.totalMiles << " miles "
+             << setprecision(3) << job.seconds * 1000 << " ms" << endl;
+        if (argc == 4)
+        {
+            string outFile = string(argv[3]) + "/" + baseName(job.deliveriesFile) + ".out";
+            ofstream outf(outFile);
+            if (!outf)
+            {
+                cout << "Unable to write " << outFile << endl;
+                return 1;
+            }
+            outf << job.output;
+        }
+    }
+
+    cout << "jobs " << jobs.size() << ", failed " << failed
+         << ", threads " << ThreadPool::shared().size() << endl;
+    cout << setprecision(3) << "map load " << loadSeconds << " s, batch " << batchSeconds << " s, "
+         << jobs.size() / batchSeconds << " jobs/s" << endl;
+    cout << "latency p50 " << percentile(latencies, 0.50) * 1000 << " ms, p99 "
+         << percentile(latencies, 0.99) * 1000 << " ms" << endl;
+    return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,1203 @@
+// Benchmark.cpp
+
+// Performance checks that don't need a human watching the output.  Build it instead of
+// main.cpp:
+//
+//     Benchmark suite mapdata.txt [out.json]
+//                                         load, hash map, routing, optimizer and planner numbers as
+//                                         JSON, for comparing runs over time
+//     Benchmark scaling [maxEdges] [out.json]
+//                                         the same on generated cities of 10k edges up to maxEdges
+//                                         (default 10M); see SyntheticCity.h
+//     Benchmark tiles mapdata.txt         local jobs on tiles loaded on demand vs. on the whole map
+//     Benchmark isochrone mapdata.txt [miles]
+//                                         service areas (default 3 miles) one at a time and in parallel
+//     Benchmark depots mapdata.txt [depots]
+//                                         nearest depot by DepotPartition lookup vs. routing from each
+//     Benchmark names mapdata.txt         street name prefix and intersection lookups vs. a scan
+//     Benchmark concurrent mapdata.txt [threads]
+//                                         stress check of ConcurrentHashMap, then its throughput from 1
+//                                         thread up against ExpandableHashMap behind a mutex
+//     Benchmark layout mapdata.txt        routing on the node order as loaded vs. BFS and Hilbert order
+//     Benchmark trace                     cost of one TRACE_SPAN, 0 unless built with -DPLAN_TRACE
+//     Benchmark anytime                   quality of optimizeDeliveryOrderWithin vs. time budget and threads
+//     Benchmark geometry mapdata.txt      size and speed of route geometry exports vs. a text dump
+//     Benchmark turns mapdata.txt         turn-penalized routing vs. the plain search: latency, miles, turns
+//
+// Workloads come from fixed seeds, so two runs on the same machine are comparable.
+
+#include "provided.h"
+#include "RouteGeometry.h"
+#include "ExpandableHashMap.h"
+#include "ConcurrentHashMap.h"
+#include "SyntheticCity.h"
+#include "DeliveryIO.h"
+#include "Trace.h"
+#include "TiledMap.h"
+#include "DepotPartition.h"
+#include "ThreadPool.h"
+#include <sys/resource.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <cstring>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cmath>
+using namespace std;
+
+// n stops scattered over roughly the area mapdata.txt covers
+static void randomDeliveries(int n, unsigned seed, GeoCoord& depot, vector<DeliveryRequest>& deliveries)
+{
+    mt19937 rng(seed);
+    uniform_real_distribution<double> lat(34.02, 34.10);
+    uniform_real_distribution<double> lon(-118.52, -118.38);
+    depot = GeoCoord(to_string(lat(rng)), to_string(lon(rng)));
+    deliveries.clear();
+    for (int i = 0; i < n; i++)
+        deliveries.push_back(DeliveryRequest("stop " + to_string(i), GeoCoord(to_string(lat(rng)), to_string(lon(rng)))));
+}
+
+static double closedTourMiles(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries)
+{
+    double miles = distanceEarthMiles(depot, deliveries.front().location) + distanceEarthMiles(deliveries.back().location, depot);
+    for (size_t i = 0; i + 1 < deliveries.size(); i++)
+        miles += distanceEarthMiles(deliveries[i].location, deliveries[i + 1].location);
+    return miles;
+}
+
+static void benchAnytime()
+{
+    const int sizes[] = { 50, 200, 1000 };
+    const double budgets[] = { 0.01, 0.1, 1.0 };
+    int maxThreads = max(1u, thread::hardware_concurrency());
+
+    DeliveryOptimizer optimizer(nullptr);
+    cout << "stops  threads  budget_s  elapsed_s  closed_miles  vs_heuristic" << endl;
+    for (int n : sizes)
+    {
+        GeoCoord depot;
+        vector<DeliveryRequest> original;
+        randomDeliveries(n, 1000 + n, depot, original);
+
+        double oldCrow, newCrow;
+        vector<DeliveryRequest> heuristic = original;
+        optimizer.optimizeDeliveryOrder(depot, heuristic, oldCrow, newCrow);
+        double heuristicMiles = closedTourMiles(depot, heuristic);
+
+        for (int threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            for (double budget : budgets)
+            {
+                vector<DeliveryRequest> deliveries = original;
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                optimizer.optimizeDeliveryOrderWithin(depot, deliveries, budget, threads, oldCrow, newCrow);
+                double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                double miles = closedTourMiles(depot, deliveries);
+                cout << setw(5) << n << setw(9) << threads << setw(10) << budget
+                     << fixed << setprecision(3) << setw(11) << elapsed << setw(14) << miles
+                     << setw(13) << miles / heuristicMiles << defaultfloat << endl;
+            }
+        }
+    }
+}
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Routes between random pairs of map nodes, then encodes every route each way many times.
+static void benchGeometry(const string& mapFile)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return;
+    }
+    PointToPointRouter router(&sm);
+    mt19937 rng(39);
+    vector<StreetRoute> routes;
+    long numPoints = 0;
+    while (routes.size() < 200)
+    {
+        StreetRoute route;
+        double miles;
+        const GeoCoord& from = sm.nodeCoord(rng() % sm.nodeCount());
+        const GeoCoord& to = sm.nodeCoord(rng() % sm.nodeCount());
+        if (router.generatePointToPointRoute(from, to, route, miles) == DELIVERY_SUCCESS && !route.empty())
+        {
+            numPoints += route.size() + 1;
+            routes.push_back(route);
+        }
+    }
+    const int repeats = 50;
+
+    // naive dump: the coordinates' own text, one point per line
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t textBytes = 0;
+    for (int r = 0; r < repeats; r++)
+    {
+        string text;
+        for (size_t i = 0; i < routes.size(); i++)
+            for (int k = 0; k <= routes[i].size(); k++)
+            {
+                const GeoCoord& p = routes[i].point(k);
+                text += p.latitudeText;
+                text += ' ';
+                text += p.longitudeText;
+                text += '\n';
+            }
+        textBytes = text.size();
+    }
+    double textSeconds = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    size_t polylineBytes = 0;
+    vector<string> polylines(routes.size());
+    for (int r = 0; r < repeats; r++)
+    {
+        polylineBytes = 0;
+        for (size_t i = 0; i < routes.size(); i++)
+        {
+            polylines[i].clear();
+            appendEncodedPolyline(routes[i], polylines[i]);
+            polylineBytes += polylines[i].size();
+        }
+    }
+    double polylineSeconds = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    vector<LatLon> points;
+    double worstError = 0;
+    for (int r = 0; r < repeats; r++)
+        for (size_t i = 0; i < routes.size(); i++)
+        {
+            decodePolyline(polylines[i], points);
+            if (r == 0)
+                for (size_t k = 0; k < points.size(); k++)
+                    worstError = max(worstError, fabs(points[k].first - routes[i].point(k).latitude));
+        }
+    double decodeSeconds = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    string binary;
+    for (int r = 0; r < repeats; r++)
+    {
+        ostringstream out;
+        writeRouteGeometry(out, routes);
+        binary = out.str();
+    }
+    double binarySeconds = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    vector<vector<LatLon>> legs;
+    bool readBack = true;
+    for (int r = 0; r < repeats; r++)
+    {
+        istringstream in(binary);
+        readBack = readRouteGeometry(in, legs) && readBack;
+    }
+    double readSeconds = secondsSince(start);
+
+    double pointsEncoded = double(numPoints) * repeats;
+    cout << routes.size() << " routes, " << numPoints << " points" << endl;
+    cout << "format      bytes  bytes/point  Mpoints/s" << endl;
+    cout << fixed << setprecision(2);
+    cout << "text     " << setw(8) << textBytes << setw(13) << double(textBytes) / numPoints << setw(11) << pointsEncoded / textSeconds / 1e6 << endl;
+    cout << "polyline " << setw(8) << polylineBytes << setw(13) << double(polylineBytes) / numPoints << setw(11) << pointsEncoded / polylineSeconds / 1e6 << endl;
+    cout << "binary   " << setw(8) << binary.size() << setw(13) << double(binary.size()) / numPoints << setw(11) << pointsEncoded / binarySeconds / 1e6 << endl;
+    cout << "polyline decode " << pointsEncoded / decodeSeconds / 1e6 << " Mpoints/s, worst latitude error "
+         << scientific << worstError << fixed << endl;
+    cout << "binary read " << pointsEncoded / readSeconds / 1e6 << " Mpoints/s, " << (readBack ? "ok" : "FAILED") << endl;
+}
+
+// what a route asks of the driver: the turn commands a plan would give for it (one per change
+// of street name) and the turns of each class at every node along it
+struct RouteTurns
+{
+    RouteTurns()
+     : commands(0)
+    {
+        fill(byClass, byClass + 4, 0);
+    }
+    int commands;
+    int byClass[4];
+};
+
+static void countTurns(const StreetMap& sm, const StreetRoute& route, RouteTurns& turns)
+{
+    for (int i = 1; i < route.size(); i++)
+    {
+        int from = route.edgeId(i - 1), onto = route.edgeId(i);
+        if (sm.edgeNameId(from) != sm.edgeNameId(onto))
+            turns.commands++;
+        const vector<int>& next = sm.edgesFrom(sm.edgeTo(from));
+        int k = int(find(next.begin(), next.end(), onto) - next.begin());
+        turns.byClass[sm.turnClass(from, k)]++;
+    }
+}
+
+// Routes the same random pairs of connected nodes with and without turn penalties.
+static void benchTurns(const string& mapFile)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return;
+    }
+    mt19937 rng(40);
+    vector<pair<int, int>> pairs;
+    while (pairs.size() < 500)
+    {
+        int from = rng() % sm.nodeCount(), to = rng() % sm.nodeCount();
+        if (from != to && sm.nodeComponent(from) == sm.nodeComponent(to))
+            pairs.push_back(make_pair(from, to));
+    }
+
+    // roughly the time a left, right or U-turn costs in town, as miles of driving at 20mph
+    const double left = 0.05, right = 0.02, uTurn = 0.25;
+    cout << "penalties (miles): left " << left << ", right " << right << ", U-turn " << uTurn << endl;
+    cout << "search       us/query      miles  turn_cmds  lefts  rights  u_turns" << endl;
+    double plainSeconds = 0;
+    for (int turnAware = 0; turnAware <= 1; turnAware++)
+    {
+        PointToPointRouter router(&sm);
+        if (turnAware)
+            router.setTurnPenalties(left, right, uTurn);
+        StreetRoute route;
+        double miles = 0, legMiles;
+        RouteTurns turns;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            router.generatePointToPointRoute(sm.nodeCoord(pairs[i].first), sm.nodeCoord(pairs[i].second), route, legMiles);
+            miles += legMiles;
+        }
+        double seconds = secondsSince(start);
+        if (!turnAware)
+            plainSeconds = seconds;
+
+        // counted on a second pass so the timing above is only the searches
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            router.generatePointToPointRoute(sm.nodeCoord(pairs[i].first), sm.nodeCoord(pairs[i].second), route, legMiles);
+            countTurns(sm, route, turns);
+        }
+        cout << (turnAware ? "turn-aware" : "plain     ") << fixed << setprecision(1)
+             << setw(14) << seconds / pairs.size() * 1e6 << setw(11) << miles
+             << setw(11) << turns.commands << setw(7) << turns.byClass[StreetMap::TURN_LEFT]
+             << setw(8) << turns.byClass[StreetMap::TURN_RIGHT] << setw(9) << turns.byClass[StreetMap::TURN_U] << endl;
+        if (turnAware)
+            cout << "query overhead " << setprecision(2) << seconds / plainSeconds << "x" << defaultfloat << endl;
+    }
+}
+
+// peak resident set size so far, in kilobytes
+static long peakRssKb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;   // bytes there, kilobytes on Linux
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// depot and n delivery locations at random nodes of the depot's part of the map
+static void randomMapStops(const StreetMap& sm, mt19937& rng, int n, GeoCoord& depot, vector<DeliveryRequest>& deliveries)
+{
+    int depotNode = rng() % sm.nodeCount();
+    depot = sm.nodeCoord(depotNode);
+    deliveries.clear();
+    while (deliveries.size() < n)
+    {
+        int node = rng() % sm.nodeCount();
+        if (sm.nodeComponent(node) == sm.nodeComponent(depotNode))
+            deliveries.push_back(DeliveryRequest("stop " + to_string(deliveries.size()), sm.nodeCoord(node)));
+    }
+}
+
+// text as a quoted JSON string
+static string jsonString(const string& text)
+{
+    string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// writes "p50", "p90", ... of samples, which it sorts, as JSON members
+static void writePercentiles(ostream& out, vector<double>& samples)
+{
+    sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double x : samples)
+        sum += x;
+    const double ps[] = { 0.5, 0.9, 0.99 };
+    const char* names[] = { "p50", "p90", "p99" };
+    out << "\"mean\": " << sum / samples.size();
+    for (int i = 0; i < 3; i++)
+        out << ", \"" << names[i] << "\": " << samples[min(samples.size() - 1, size_t(ps[i] * samples.size()))];
+    out << ", \"max\": " << samples.back();
+}
+
+static bool suiteLoad(const string& mapFile, StreetMap& sm, ostream& out)
+{
+    long rssBefore = peakRssKb();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (!sm.load(mapFile))
+        return false;
+    double firstSeconds = secondsSince(start);
+    long rssGrowth = peakRssKb() - rssBefore;
+
+    // later loads into fresh maps, for a steadier time than the cold first one
+    vector<double> seconds;
+    for (int i = 0; i < 3; i++)
+    {
+        StreetMap again;
+        start = chrono::steady_clock::now();
+        again.load(mapFile);
+        seconds.push_back(secondsSince(start));
+    }
+    sort(seconds.begin(), seconds.end());
+    out << "  \"load\": {\"nodes\": " << sm.nodeCount() << ", \"edges\": " << sm.edgeCount()
+        << ", \"first_seconds\": " << firstSeconds << ", \"median_seconds\": " << seconds[1]
+        << ", \"peak_rss_growth_kb\": " << rssGrowth << "},\n";
+    return true;
+}
+
+// the map's own coordinates as keys, so hashing costs what it does while loading
+static void suiteHashMap(const StreetMap& sm, ostream& out)
+{
+    int n = sm.nodeCount();
+    vector<GeoCoord> misses;
+    for (int i = 0; i < n; i++)
+    {
+        const GeoCoord& g = sm.nodeCoord(i);
+        misses.push_back(GeoCoord(g.latitudeText + "1", g.longitudeText));
+    }
+
+    ExpandableHashMap<GeoCoord, int> map;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+        map.associate(sm.nodeCoord(i), i);
+    double insertSeconds = secondsSince(start);
+
+    const int rounds = 5;
+    long found = 0;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < n; i++)
+            found += map.find(sm.nodeCoord(i)) != nullptr;
+    double hitSeconds = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < n; i++)
+            found += map.find(misses[i]) != nullptr;
+    double missSeconds = secondsSince(start);
+
+    out << "  \"hash_map\": {\"keys\": " << n << ", \"insert_ns\": " << insertSeconds / n * 1e9
+        << ", \"find_hit_ns\": " << hitSeconds / (double(n) * rounds) * 1e9
+        << ", \"find_miss_ns\": " << missSeconds / (double(n) * rounds) * 1e9
+        << ", \"found\": " << found << "},\n";
+}
+
+static void suiteRouting(const StreetMap& sm, mt19937& rng, ostream& out)
+{
+    PointToPointRouter router(&sm);
+    StreetRoute route;
+    vector<double> micros;
+    double miles, totalMiles = 0;
+    while (micros.size() < 1000)
+    {
+        int from = rng() % sm.nodeCount(), to = rng() % sm.nodeCount();
+        if (sm.nodeComponent(from) != sm.nodeComponent(to))
+            continue;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        router.generatePointToPointRoute(sm.nodeCoord(from), sm.nodeCoord(to), route, miles);
+        micros.push_back(secondsSince(start) * 1e6);
+        totalMiles += miles;
+    }
+    out << "  \"routing\": {\"queries\": " << micros.size() << ", \"total_miles\": " << totalMiles << ", \"latency_us\": {";
+    writePercentiles(out, micros);
+    out << "}},\n";
+}
+
+// after routing, so the search scratch is what a thousand queries left behind
+static void suiteMemory(const StreetMap& sm, ostream& out)
+{
+    MapMemoryReport report = sm.memoryReport();
+    out << "  \"memory_bytes\": {\"node_index\": " << report.nodeIndex << ", \"coordinates\": " << report.coordinates
+        << ", \"adjacency\": " << report.adjacency << ", \"edges\": " << report.edges << ", \"turns\": " << report.turns
+        << ", \"names\": " << report.names << ", \"strings\": " << report.strings << ", \"search_scratch\": " << report.searchScratch
+        << ", \"total\": " << report.total() << ", \"peak_rss\": " << peakRssKb() * 1024 << "},\n";
+}
+
+static void suiteOptimizer(const StreetMap& sm, mt19937& rng, ostream& out)
+{
+    const int sizes[] = { 5, 10, 25, 50, 100, 250 };
+    DeliveryOptimizer optimizer(&sm);
+    out << "  \"optimizer\": [";
+    for (int i = 0; i < 6; i++)
+    {
+        GeoCoord depot;
+        vector<DeliveryRequest> deliveries;
+        randomMapStops(sm, rng, sizes[i], depot, deliveries);
+        double oldCrow, newCrow;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        optimizer.optimizeDeliveryOrder(depot, deliveries, oldCrow, newCrow);
+        double seconds = secondsSince(start);
+        out << (i ? ",\n    " : "\n    ") << "{\"stops\": " << sizes[i] << ", \"seconds\": " << seconds
+            << ", \"old_crow_miles\": " << oldCrow << ", \"new_crow_miles\": " << newCrow
+            << ", \"ratio\": " << newCrow / oldCrow << "}";
+    }
+    out << "\n  ],\n";
+}
+
+static void suitePlanner(const StreetMap& sm, mt19937& rng, ostream& out)
+{
+    const int plans = 20, stops = 10;
+    vector<GeoCoord> depots(plans);
+    vector<vector<DeliveryRequest>> deliveries(plans);
+    for (int i = 0; i < plans; i++)
+        randomMapStops(sm, rng, stops, depots[i], deliveries[i]);
+
+    DeliveryPlanner planner(&sm);
+    vector<DeliveryCommand> commands;
+    vector<double> millis;
+    int succeeded = 0;
+    double miles;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < plans; i++)
+    {
+        chrono::steady_clock::time_point planStart = chrono::steady_clock::now();
+        succeeded += planner.generateDeliveryPlan(depots[i], deliveries[i], commands, miles) == DELIVERY_SUCCESS;
+        millis.push_back(secondsSince(planStart) * 1e3);
+    }
+    double seconds = secondsSince(start);
+    out << "  \"planner\": {\"plans\": " << plans << ", \"stops_per_plan\": " << stops
+        << ", \"succeeded\": " << succeeded << ", \"plans_per_second\": " << plans / seconds << ", \"latency_ms\": {";
+    writePercentiles(out, millis);
+    out << "}}\n";
+}
+
+// Every section draws its workload from one fixed seed, so the numbers only move when the code
+// or the machine does.
+static bool benchSuite(const string& mapFile, const string& jsonFile)
+{
+    ostringstream out;
+    out << setprecision(6);
+    out << "{\n  \"seed\": 41, \"map\": " << jsonString(mapFile) << ", \"hardware_threads\": " << thread::hardware_concurrency() << ",\n";
+    StreetMap sm;
+    if (!suiteLoad(mapFile, sm, out))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return false;
+    }
+    mt19937 rng(41);
+    suiteHashMap(sm, out);
+    suiteRouting(sm, rng, out);
+    suiteMemory(sm, out);
+    suiteOptimizer(sm, rng, out);
+    suitePlanner(sm, rng, out);
+    out << "}\n";
+
+    if (jsonFile.empty())
+    {
+        cout << out.str();
+        return true;
+    }
+    ofstream file(jsonFile);
+    file << out.str();
+    if (!file)
+    {
+        cout << "Unable to write " << jsonFile << endl;
+        return false;
+    }
+    return true;
+}
+
+// One generated city per size, each written to a scratch file, loaded, routed on and planned
+// over.  Sizes go up so the peak RSS growth of each is its own.
+static bool benchScaling(long maxEdges, const string& jsonFile)
+{
+    const long sizes[] = { 10000, 100000, 1000000, 10000000 };
+    const string scratch = "scaling-map.txt";
+    ostringstream out;
+    out << setprecision(6);
+    out << "{\n  \"seed\": 42, \"hardware_threads\": " << thread::hardware_concurrency() << ", \"cities\": [";
+    bool first = true;
+    for (long edges : sizes)
+    {
+        if (edges > maxEdges)
+            break;
+        CityOptions city;
+        city.segments = edges / 2;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        {
+            ofstream mapOut(scratch);
+            writeSyntheticCity(mapOut, city);
+            if (!mapOut)
+            {
+                cout << "Unable to write " << scratch << endl;
+                return false;
+            }
+        }
+        double generateSeconds = secondsSince(start);
+
+        long rssBefore = peakRssKb();
+        StreetMap sm;
+        start = chrono::steady_clock::now();
+        bool loaded = sm.load(scratch);
+        double loadSeconds = secondsSince(start);
+        long rssGrowth = peakRssKb() - rssBefore;
+        remove(scratch.c_str());
+        if (!loaded)
+            return false;
+
+        mt19937 rng(42);
+        PointToPointRouter router(&sm);
+        StreetRoute route;
+        vector<double> micros;
+        double miles;
+        while (micros.size() < 200)
+        {
+            int from = rng() % sm.nodeCount(), to = rng() % sm.nodeCount();
+            if (sm.nodeComponent(from) != sm.nodeComponent(to))
+                continue;
+            chrono::steady_clock::time_point queryStart = chrono::steady_clock::now();
+            router.generatePointToPointRoute(sm.nodeCoord(from), sm.nodeCoord(to), route, miles);
+            micros.push_back(secondsSince(queryStart) * 1e6);
+        }
+
+        // a clustered workload, the way a day's orders bunch up in a few neighborhoods
+        WorkloadOptions workload;
+        workload.stops = 25;
+        stringstream deliveriesText;
+        writeSyntheticDeliveries(deliveriesText, city, workload);
+        GeoCoord depot;
+        vector<DeliveryRequest> deliveries;
+        readDeliveryRequests(deliveriesText, depot, deliveries, cout);
+        DeliveryPlanner planner(&sm);
+        vector<DeliveryCommand> commands;
+        start = chrono::steady_clock::now();
+        DeliveryResult result = planner.generateDeliveryPlan(depot, deliveries, commands, miles);
+        double planSeconds = secondsSince(start);
+
+        out << (first ? "\n" : ",\n") << "    {\"edges\": " << sm.edgeCount() << ", \"nodes\": " << sm.nodeCount()
+            << ", \"generate_seconds\": " << generateSeconds << ", \"load_seconds\": " << loadSeconds
+            << ", \"peak_rss_growth_kb\": " << rssGrowth << ",\n     \"route_latency_us\": {";
+        writePercentiles(out, micros);
+        out << "}, \"plan_stops\": " << deliveries.size() << ", \"plan_ok\": " << (result == DELIVERY_SUCCESS ? "true" : "false")
+            << ", \"plan_seconds\": " << planSeconds << "}";
+        first = false;
+        cerr << "scaling: " << sm.edgeCount() << " edges done" << endl;
+    }
+    out << "\n  ]\n}\n";
+
+    if (jsonFile.empty())
+    {
+        cout << out.str();
+        return true;
+    }
+    ofstream file(jsonFile);
+    file << out.str();
+    return bool(file);
+}
+
+// Jobs confined to a couple of miles, planned on the whole map and on a TiledMap (whose index
+// is built by a first open that isn't timed).  Startup is the load or the index read.
+static void benchTiles(const string& mapFile)
+{
+    {
+        TiledMap indexer;
+        if (!indexer.open(mapFile))
+        {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return;
+        }
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    StreetMap whole;
+    whole.load(mapFile);
+    double wholeStartup = secondsSince(start);
+    DeliveryPlanner planner(&whole);
+
+    start = chrono::steady_clock::now();
+    TiledMap tiled;
+    tiled.open(mapFile);
+    double tiledStartup = secondsSince(start);
+
+    cout << "startup seconds: whole " << wholeStartup << ", tiled " << tiledStartup << " (" << tiled.tileCount() << " tiles)" << endl;
+    cout << "job  whole_ms  tiled_ms  tiles  expansions  whole_bytes  tiled_bytes  same_miles" << endl;
+    mt19937 rng(45);
+    for (int job = 0; job < 10; job++)
+    {
+        const GeoCoord& center = whole.nodeCoord(rng() % whole.nodeCount());
+        vector<DeliveryRequest> deliveries;
+        while (deliveries.size() < 8)
+        {
+            int node = rng() % whole.nodeCount();
+            if (distanceEarthMiles(whole.nodeCoord(node), center) < 1.0)
+                deliveries.push_back(DeliveryRequest("stop", whole.nodeCoord(node)));
+        }
+        vector<DeliveryCommand> commands;
+        double wholeMiles = 0, tiledMiles = 0;
+        start = chrono::steady_clock::now();
+        planner.generateDeliveryPlan(center, deliveries, commands, wholeMiles);
+        double wholeSeconds = secondsSince(start);
+        start = chrono::steady_clock::now();
+        tiled.generateDeliveryPlan(center, deliveries, commands, tiledMiles);
+        double tiledSeconds = secondsSince(start);
+
+        // scratch is shared by both, so only the map's own structures are compared
+        MapMemoryReport w = whole.memoryReport(), t = tiled.lastMap()->memoryReport();
+        cout << setw(3) << job << fixed << setprecision(2) << setw(10) << wholeSeconds * 1e3 << setw(10) << tiledSeconds * 1e3
+             << setw(7) << tiled.tilesLoaded() << setw(12) << tiled.expansions()
+             << setw(13) << w.total() - w.searchScratch - w.strings << setw(13) << t.total() - t.searchScratch - t.strings
+             << setw(12) << (fabs(wholeMiles - tiledMiles) < 1e-9 ? "yes" : "NO") << defaultfloat << endl;
+    }
+}
+
+// Service areas of a given radius around random depots: the latency of one, then a batch of
+// depots one after another against generateServiceAreas spreading them over the pool.
+static void benchIsochrone(const string& mapFile, double miles)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return;
+    }
+    mt19937 rng(46);
+    vector<GeoCoord> depots;
+    for (int i = 0; i < 64; i++)
+        depots.push_back(sm.nodeCoord(rng() % sm.nodeCount()));
+
+    PointToPointRouter router(&sm);
+    ServiceArea area;
+    vector<double> millis;
+    double edges = 0, boundary = 0;
+    for (size_t i = 0; i < depots.size(); i++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        router.generateServiceArea(depots[i], miles, area);
+        millis.push_back(secondsSince(start) * 1e3);
+        edges += area.edges.size();
+        boundary += area.boundaryEdges.size();
+    }
+    cout << miles << "-mile service area, " << depots.size() << " depots: mean " << edges / depots.size()
+         << " edges inside, " << boundary / depots.size() << " on the boundary" << endl << "ms per area: {";
+    writePercentiles(cout, millis);
+    cout << "}" << endl;
+
+    double sequential = 0;
+    for (double ms : millis)
+        sequential += ms;
+    vector<ServiceArea> areas;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    router.generateServiceAreas(depots, miles, areas);
+    cout << "all depots: " << sequential << " ms one by one, " << secondsSince(start) * 1e3
+         << " ms in parallel on " << ThreadPool::shared().size() << " threads" << endl;
+}
+
+// Nearest of a set of depots for random orders: a route from every depot per order against a
+// lookup in a DepotPartition, then adding and removing one depot against labeling from scratch.
+static void benchDepots(const string& mapFile, int numDepots)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return;
+    }
+    mt19937 rng(47);
+    vector<GeoCoord> depots;
+    for (int i = 0; i < numDepots; i++)
+        depots.push_back(sm.nodeCoord(rng() % sm.nodeCount()));
+    vector<GeoCoord> orders;
+    for (int i = 0; i < 50; i++)
+        orders.push_back(sm.nodeCoord(rng() % sm.nodeCount()));
+
+    DepotPartition partition(&sm);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    partition.setDepots(depots);
+    double buildSeconds = secondsSince(start);
+
+    PointToPointRouter router(&sm);
+    StreetRoute route;
+    vector<double> routedMiles(orders.size(), -1);
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < orders.size(); i++)
+    {
+        double miles;
+        for (size_t d = 0; d < depots.size(); d++)
+            if (router.generatePointToPointRoute(depots[d], orders[i], route, miles) == DELIVERY_SUCCESS &&
+                (routedMiles[i] < 0 || miles < routedMiles[i]))
+                routedMiles[i] = miles;
+    }
+    double routeSeconds = secondsSince(start);
+
+    int agree = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < orders.size(); i++)
+    {
+        int depot;
+        double miles = -1;
+        partition.nearestDepot(orders[i], depot, miles);
+        agree += fabs(miles - routedMiles[i]) < 1e-9;
+    }
+    double lookupSeconds = secondsSince(start);
+
+    cout << numDepots << " depots, " << orders.size() << " orders (" << agree << " nearest distances agree)" << endl;
+    cout << fixed << setprecision(3) << "partition from scratch " << buildSeconds * 1e3 << " ms" << endl;
+    cout << "per order: " << routeSeconds / orders.size() * 1e3 << " ms routing from every depot, "
+         << lookupSeconds / orders.size() * 1e9 << " ns looking up" << endl;
+
+    // one more depot comes and goes; the labels must end up as a fresh partition's
+    GeoCoord extra = sm.nodeCoord(rng() % sm.nodeCount());
+    start = chrono::steady_clock::now();
+    int extraId = partition.addDepot(extra);
+    double addSeconds = secondsSince(start);
+    depots.push_back(extra);
+    DepotPartition fresh(&sm);
+    fresh.setDepots(depots);
+    bool sameAfterAdd = true;
+    for (int n = 0; n < sm.nodeCount(); n++)
+        sameAfterAdd = sameAfterAdd && partition.nodeDepot(n) == fresh.nodeDepot(n) && partition.nodeDistance(n) == fresh.nodeDistance(n);
+
+    start = chrono::steady_clock::now();
+    partition.removeDepot(extraId);
+    double removeSeconds = secondsSince(start);
+    depots.pop_back();
+    fresh.setDepots(depots);
+    bool sameAfterRemove = true;
+    for (int n = 0; n < sm.nodeCount(); n++)
+        sameAfterRemove = sameAfterRemove && partition.nodeDepot(n) == fresh.nodeDepot(n) && partition.nodeDistance(n) == fresh.nodeDistance(n);
+    cout << "add a depot " << addSeconds * 1e3 << " ms (" << (sameAfterAdd ? "same" : "DIFFERENT")
+         << "), remove it " << removeSeconds * 1e3 << " ms (" << (sameAfterRemove ? "same" : "DIFFERENT") << ")" << defaultfloat << endl;
+}
+
+// Street name lookups a dispatcher would type, through the name index and by scanning every
+// edge's name the way finding a street took before there was one.
+static void benchNames(const string& mapFile)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return;
+    }
+    vector<int> allStreets;
+    sm.findStreets("", allStreets);
+    MapMemoryReport report = sm.memoryReport();
+    cout << allStreets.size() << " street names, index " << report.names << " bytes" << endl;
+
+    // prefixes of real names, cased the way people type them
+    mt19937 rng(48);
+    vector<string> prefixes;
+    for (int i = 0; i < 200; i++)
+    {
+        string name = sm.edgeName(rng() % sm.edgeCount());
+        string prefix = name.substr(0, min(name.size(), size_t(3 + rng() % 6)));
+        transform(prefix.begin(), prefix.end(), prefix.begin(), ::tolower);
+        prefixes.push_back(prefix);
+    }
+
+    const int rounds = 20;
+    vector<int> nameIds;
+    size_t found = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < prefixes.size(); i++)
+        {
+            sm.findStreets(prefixes[i], nameIds);
+            found += nameIds.size();
+        }
+    double indexSeconds = secondsSince(start) / (rounds * prefixes.size());
+
+    size_t scanned = 0;
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < 10; i++)
+    {
+        for (int e = 0; e < sm.edgeCount(); e++)
+        {
+            const string& name = sm.edgeName(e);
+            bool match = name.size() >= prefixes[i].size();
+            for (size_t k = 0; match && k < prefixes[i].size(); k++)
+                match = tolower((unsigned char)name[k]) == prefixes[i][k];
+            scanned += match;
+        }
+    }
+    double scanSeconds = secondsSince(start) / 10;
+    cout << fixed << setprecision(2) << "prefix lookup: " << indexSeconds * 1e6 << " us indexed, "
+         << scanSeconds * 1e6 << " us scanning edges (" << double(found) / (rounds * prefixes.size()) << " names per prefix)" << endl;
+
+    // every pair of streets that meet at some node, as the two names' first words
+    vector<string> queries;
+    while (queries.size() < 200)
+    {
+        int node = rng() % sm.nodeCount();
+        const vector<int>& edges = sm.edgesFrom(node);
+        for (size_t a = 0; a < edges.size(); a++)
+            for (size_t b = 0; b < edges.size(); b++)
+            {
+                const string& first = sm.edgeName(edges[a]);
+                const string& second = sm.edgeName(edges[b]);
+                if (first.substr(0, first.find(' ')) != second.substr(0, second.find(' ')) && queries.size() < 200)
+                    queries.push_back(first.substr(0, first.find(' ')) + " & " + second.substr(0, second.find(' ')));
+            }
+    }
+    vector<int> nodes;
+    int answered = 0;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < queries.size(); i++)
+            answered += sm.findIntersections(queries[i], nodes);
+    cout << "intersection lookup: " << secondsSince(start) / (rounds * queries.size()) * 1e6 << " us ("
+         << answered / rounds << " of " << queries.size() << " found)" << defaultfloat << endl;
+}
+
+// Writers keep bumping a version in each key's value while readers check that no key ever
+// shows a value belonging to another key or goes back to an older version.  The map starts
+// empty, so the shards grow while all of it is going on.
+static bool stressConcurrentMap(const StreetMap& sm, int numThreads, double seconds)
+{
+    int n = sm.nodeCount();
+    ConcurrentHashMap<GeoCoord, long> map;
+    int numWriters = max(1, numThreads / 4), numReaders = max(1, numThreads - numWriters);
+    atomic<bool> stop(false), failed(false);
+    atomic<long> reads(0), writes(0);
+    vector<long> finalVersion(numWriters);
+    vector<thread> threads;
+    for (int w = 0; w < numWriters; w++)
+        threads.push_back(thread([&, w]() {
+            // writer w owns the keys i with i % numWriters == w; a value is key * 2^20 + version
+            long version = 0, count = 0;
+            while (!stop && version < (1 << 20) - 1)
+            {
+                version++;
+                for (int i = w; i < n && !stop; i += numWriters, count++)
+                    map.associate(sm.nodeCoord(i), long(i) << 20 | version);
+            }
+            finalVersion[w] = stop ? version - 1 : version;   // the last pass may not have finished
+            writes += count;
+        }));
+    for (int r = 0; r < numReaders; r++)
+        threads.push_back(thread([&, r]() {
+            mt19937 rng(49 + r);
+            vector<long> seen(n, 0);
+            long count = 0, value;
+            while (!stop)
+            {
+                int i = rng() % n;
+                count++;
+                if (!map.find(sm.nodeCoord(i), value))
+                    continue;
+                if ((value >> 20) != i || (value & ((1 << 20) - 1)) < seen[i])
+                    failed = true;
+                seen[i] = value & ((1 << 20) - 1);
+            }
+            reads += count;
+        }));
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop = true;
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    // every key was written at least once and holds at least its writer's last full pass
+    bool complete = map.size() == n;
+    long value;
+    for (int i = 0; i < n && complete; i++)
+        complete = map.find(sm.nodeCoord(i), value) && (value >> 20) == i && (value & ((1 << 20) - 1)) >= finalVersion[i % numWriters];
+    cout << "stress: " << numWriters << " writers, " << numReaders << " readers, " << writes << " writes, " << reads
+         << " reads: " << (!failed && complete ? "ok" : "FAILED") << endl;
+    return !failed && complete;
+}
+
+// Lookups per second from 1 to maxThreads threads sharing one map, with 1 in 20 operations an
+// update: the concurrent map against an ExpandableHashMap behind a mutex.
+static void benchConcurrentMap(const string& mapFile, int maxThreads)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return;
+    }
+    if (!stressConcurrentMap(sm, max(4, maxThreads), 2.0))
+        return;
+
+    int n = sm.nodeCount();
+    ConcurrentHashMap<GeoCoord, int> concurrent;
+    ExpandableHashMap<GeoCoord, int> locked;
+    mutex lock;
+    for (int i = 0; i < n; i++)
+    {
+        concurrent.associate(sm.nodeCoord(i), i);
+        locked.associate(sm.nodeCoord(i), i);
+    }
+    const int opsPerThread = 500000;
+    cout << "threads  concurrent_Mops  locked_Mops" << endl;
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        double mops[2];
+        for (int which = 0; which < 2; which++)
+        {
+            vector<thread> threads;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (int t = 0; t < numThreads; t++)
+                threads.push_back(thread([&, t]() {
+                    mt19937 rng(t);
+                    int value;
+                    for (int op = 0; op < opsPerThread; op++)
+                    {
+                        int i = rng() % n;
+                        bool update = op % 20 == 0;
+                        if (which == 0 && update)
+                            concurrent.associate(sm.nodeCoord(i), i);
+                        else if (which == 0)
+                            concurrent.find(sm.nodeCoord(i), value);
+                        else
+                        {
+                            lock_guard<mutex> guard(lock);
+                            if (update)
+                                locked.associate(sm.nodeCoord(i), i);
+                            else
+                                locked.find(sm.nodeCoord(i));
+                        }
+                    }
+                }));
+            for (size_t t = 0; t < threads.size(); t++)
+                threads[t].join();
+            mops[which] = double(opsPerThread) * numThreads / secondsSince(start) / 1e6;
+        }
+        cout << setw(7) << numThreads << fixed << setprecision(2) << setw(17) << mops[0] << setw(13) << mops[1] << defaultfloat << endl;
+    }
+}
+
+// Counts the calling thread's last-level cache misses between start() and stop() through the
+// kernel's perf events, where there are any; elsewhere, or where the kernel refuses (containers
+// and VMs often do), available() is false and the count stays 0.
+class CacheMissCounter
+{
+public:
+    CacheMissCounter()
+     : m_fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+
+    bool available() const
+    {
+        return m_fd >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    long long stop()
+    {
+        long long count = 0;
+#ifdef __linux__
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+#endif
+        return count;
+    }
+
+    CacheMissCounter(const CacheMissCounter&) = delete;
+    CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+private:
+    int m_fd;
+};
+
+// The same routes on the map as loaded and after each reordering: how far apart in id the two
+// ends of an edge are on average, route latency, and cache misses where perf events work.
+static void benchLayout(const string& mapFile)
+{
+    StreetMap sm;
+    if (!sm.load(mapFile))
+    {
+        cout << "Unable to load map data file " << mapFile << endl;
+        return;
+    }
+    // picked as coordinates, since ids change with the order
+    mt19937 rng(50);
+    vector<pair<GeoCoord, GeoCoord>> pairs;
+    while (pairs.size() < 500)
+    {
+        int from = rng() % sm.nodeCount(), to = rng() % sm.nodeCount();
+        if (sm.nodeComponent(from) == sm.nodeComponent(to))
+            pairs.push_back(make_pair(sm.nodeCoord(from), sm.nodeCoord(to)));
+    }
+
+    CacheMissCounter misses;
+    if (!misses.available())
+        cout << "perf events unavailable here, so no cache miss counts" << endl;
+    const StreetMap::NodeOrder orders[] = { StreetMap::ORDER_FILE, StreetMap::ORDER_BFS, StreetMap::ORDER_HILBERT };
+    const char* names[] = { "file", "bfs", "hilbert" };
+    cout << "order    reorder_ms  mean_edge_span  us/route  misses/route  miles" << endl;
+    double fileMiles = 0;
+    for (int o = 0; o < 3; o++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        sm.reorderNodes(orders[o]);
+        double reorderSeconds = secondsSince(start);
+        double span = 0;
+        for (int e = 0; e < sm.edgeCount(); e++)
+            span += abs(sm.edgeFrom(e) - sm.edgeTo(e));
+
+        PointToPointRouter router(&sm);
+        StreetRoute route;
+        double miles = 0, legMiles;
+        router.generatePointToPointRoute(pairs[0].first, pairs[0].second, route, legMiles);   // grows the workspace
+        misses.start();
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < pairs.size(); i++)
+        {
+            router.generatePointToPointRoute(pairs[i].first, pairs[i].second, route, legMiles);
+            miles += legMiles;
+        }
+        double seconds = secondsSince(start);
+        long long missCount = misses.stop();
+        if (o == 0)
+            fileMiles = miles;
+        cout << left << setw(8) << names[o] << right << fixed << setprecision(2) << setw(11) << reorderSeconds * 1e3
+             << setw(16) << span / sm.edgeCount() << setw(10) << seconds / pairs.size() * 1e6
+             << setw(14) << (misses.available() ? to_string(missCount / (long long)pairs.size()) : "n/a")
+             << setw(11) << miles << (fabs(miles - fileMiles) < 1e-6 * fileMiles ? "" : " DIFFERENT") << defaultfloat << endl;
+    }
+}
+
+// Opens and closes empty spans in a loop, against the same loop with nothing in it.  A span
+// reads the clock twice, so the cost of one traceNow() is shown alongside.
+static void benchTrace()
+{
+    const int spans = 10000000;
+    volatile int sink = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < spans; i++)
+        sink = sink + 1;
+    double bareSeconds = secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < spans; i++)
+    {
+        TRACE_SPAN(span, "empty");
+        TRACE_COUNT(span, "i", i);
+        sink = sink + 1;
+    }
+    double tracedSeconds = secondsSince(start);
+    clearTrace();
+
+    volatile int64_t ticks = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < spans; i++)
+        ticks = ticks + traceNow();
+    double clockSeconds = secondsSince(start);
+
+    cout << "tracing " << (traceEnabled() ? "enabled" : "disabled") << ": "
+         << fixed << setprecision(1) << (tracedSeconds - bareSeconds) / spans * 1e9 << " ns per span, "
+         << (clockSeconds - bareSeconds) / spans * 1e9 << " ns per clock read" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    string which = argc > 1 ? argv[1] : "anytime";
+    if (which == "anytime")
+        benchAnytime();
+    else if (which == "suite" && argc > 2)
+        return benchSuite(argv[2], argc > 3 ? argv[3] : "") ? 0 : 1;
+    else if (which == "tiles" && argc > 2)
+        benchTiles(argv[2]);
+    else if (which == "isochrone" && argc > 2)
+        benchIsochrone(argv[2], argc > 3 ? atof(argv[3]) : 3.0);
+    else if (which == "depots" && argc > 2)
+        benchDepots(argv[2], argc > 3 ? atoi(argv[3]) : 8);
+    else if (which == "names" && argc > 2)
+        benchNames(argv[2]);
+    else if (which == "concurrent" && argc > 2)
+        benchConcurrentMap(argv[2], argc > 3 ? atoi(argv[3]) : max(1u, thread::hardware_concurrency()));
+    else if (which == "layout" && argc > 2)
+        benchLayout(argv[2]);
+    else if (which == "trace")
+        benchTrace();
+    else if (which == "scaling")
+        return benchScaling(argc > 2 ? atol(argv[2]) : 10000000, argc > 3 ? argv[3] : "") ? 0 : 1;
+    else if (which == "geometry" && argc > 2)
+        benchGeometry(argv[2]);
+    else if (which == "turns" && argc > 2)
+        benchTurns(argv[2]);
+    else
+    {
+        cout << "Usage: " << argv[0] << " suite mapdata.txt [out.json]" << endl;
+        cout << "       " << argv[0] << " scaling [maxEdges] [out.json]" << endl;
+        cout << "       " << argv[0] << " tiles mapdata.txt" << endl;
+        cout << "       " << argv[0] << " isochrone mapdata.txt [miles]" << endl;
+        cout << "       " << argv[0] << " depots mapdata.txt [depots]" << endl;
+        cout << "       " << argv[0] << " names mapdata.txt" << endl;
+        cout << "       " << argv[0] << " concurrent mapdata.txt [threads]" << endl;
+        cout << "       " << argv[0] << " layout mapdata.txt" << endl;
+        cout << "       " << argv[0] << " trace" << endl;
+        cout << "       " << argv[0] << " anytime" << endl;
+        cout << "       " << argv[0] << " geometry mapdata.txt" << endl;
+        cout << "       " << argv[0] << " turns mapdata.txt" << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,426 @@
+// ConcurrentHashMap.h
+
+// A variant of ExpandableHashMap that many threads can use at once, for maps that are read far
+// more than written.  Keys are hashed with the same hasher() functions.
+//
+// The map is split into shards by hash, each with its own bucket array, lock and size.  Readers
+// take no lock and never wait: they follow atomic pointers from the shard's current bucket array
+// down a bucket's chain.  A writer locks only its key's shard.  Nothing a reader might be looking
+// at is changed in place: a new key is linked in at the head of its bucket, a new value replaces
+// the whole entry, and growing a shard builds a complete new bucket array and switches to it.
+// What is replaced is retired rather than deleted, and freed by epoch-based reclamation once
+// every reader that could have seen it has finished.
+//
+// Since entries can be replaced at any moment, find copies the value out instead of returning a
+// pointer to it.  reset() and the destructor must not run alongside anything else.
+
+#ifndef CONCURRENTHASHMAP_INCLUDED
+#define CONCURRENTHASHMAP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Reader registry shared by every concurrent map.  Each thread that reads gets a slot, which
+// holds the global epoch it saw on entering a read, or IDLE between reads.  Something retired
+// in epoch e can be freed once no slot holds an epoch e or earlier.
+class ReadEpochs
+{
+public:
+    static const unsigned long long IDLE = ~0ULL;
+
+    static ReadEpochs& instance()
+    {
+        static ReadEpochs epochs;
+        return epochs;
+    }
+
+      // Marks the calling thread as reading.  A store and a fence, so readers never wait on
+      // writers.  The fence pairs with the one in oldestReader: either the writer's scan sees
+      // this slot, or everything this reader loads afterwards sees what the writer unlinked.
+    void enter()
+    {
+        mySlot().store(m_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void exit()
+    {
+        mySlot().store(IDLE, std::memory_order_release);
+    }
+
+      // ends the current epoch, returning it; things retired now are tagged with it
+    unsigned long long advance()
+    {
+        return m_epoch.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+      // the oldest epoch any thread is reading in, or IDLE if none is
+    unsigned long long oldestReader() const
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        unsigned long long oldest = IDLE;
+        int used = slotsUsed();
+        for(int i = 0; i < used; i++){
+            unsigned long long e = m_slots[i].epoch.load(std::memory_order_relaxed);
+            if(e < oldest)
+                oldest = e;
+        }
+        return oldest;
+    }
+
+    ReadEpochs(const ReadEpochs&) = delete;
+    ReadEpochs& operator=(const ReadEpochs&) = delete;
+
+private:
+    static const int MAX_THREADS = 1024;
+
+    struct alignas(64) Slot{   // one cache line each, so readers don't contend
+        std::atomic<unsigned long long> epoch;
+        std::atomic<bool> taken;
+    };
+
+    Slot m_slots[MAX_THREADS];
+    std::atomic<int> m_used;                  // slots ever handed out; may run past MAX_THREADS
+    std::atomic<unsigned long long> m_epoch;
+
+    ReadEpochs()
+     : m_used(0), m_epoch(0)
+    {
+        for(int i = 0; i < MAX_THREADS; i++){
+            m_slots[i].epoch.store(IDLE, std::memory_order_relaxed);
+            m_slots[i].taken.store(false, std::memory_order_relaxed);
+        }
+    }
+
+      // a thread's slot is claimed on its first read and given back when the thread exits
+    struct SlotHolder{
+        Slot* slot;
+
+        SlotHolder()
+         : slot(ReadEpochs::instance().claim())
+        {}
+
+        ~SlotHolder()
+        {
+            slot->epoch.store(IDLE, std::memory_order_release);
+            slot->taken.store(false, std::memory_order_release);
+        }
+    };
+
+    std::atomic<unsigned long long>& mySlot()
+    {
+        static thread_local SlotHolder holder;
+        return holder.slot->epoch;
+    }
+
+    int slotsUsed() const
+    {
+        int used = m_used.load(std::memory_order_acquire);
+        return used < MAX_THREADS ? used : MAX_THREADS;
+    }
+
+      // a free slot, waiting for a thread to exit if all MAX_THREADS are taken
+    Slot* claim()
+    {
+        for(;;){
+            int used = slotsUsed();
+            for(int i = 0; i < used; i++){
+                bool expected = false;
+                if(m_slots[i].taken.compare_exchange_strong(expected, true))
+                    return &m_slots[i];
+            }
+            if(used < MAX_THREADS){
+                int i = m_used.fetch_add(1, std::memory_order_acq_rel);
+                bool expected = false;
+                if(i < MAX_THREADS && m_slots[i].taken.compare_exchange_strong(expected, true))
+                    return &m_slots[i];
+                continue;   // someone scanning took the new slot first
+            }
+            std::this_thread::yield();
+        }
+    }
+};
+
+template<typename KeyType, typename ValueType>
+class ConcurrentHashMap
+{
+public:
+    ConcurrentHashMap(double maximumLoadFactor = 0.5);
+    ~ConcurrentHashMap();
+    void reset();
+    int size() const;
+      // bytes held by the shards' buckets and entries, retired ones included
+    size_t bytesUsed() const;
+    void associate(const KeyType& key, const ValueType& value);
+      // copies key's value into value; false if key isn't in the map
+    bool find(const KeyType& key, ValueType& value) const;
+
+    ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+    ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+private:
+    static const int NUM_SHARDS = 64;
+    static const int RECLAIM_BATCH = 64;    // retirements a shard collects before trying to free them
+
+    struct Node{
+        KeyType k;
+        ValueType v;
+        unsigned int hash;
+        std::atomic<Node*> next;
+    };
+
+    struct Table{
+        int numBuckets;
+        std::atomic<Node*>* buckets;
+    };
+
+      // something no longer reachable from the shard, and the epoch it stopped being reachable in
+    struct Retired{
+        unsigned long long epoch;
+        Node* node;        // a replaced entry, or
+        Table* table;      // an outgrown bucket array and every entry in it
+    };
+
+    struct alignas(64) Shard{
+        std::atomic<Table*> table;
+        mutable std::mutex lock;                // held by writers only
+        int numAssociations;
+        std::vector<Retired> retired;
+    };
+
+    double m_maxLoadFactor;
+    Shard m_shards[NUM_SHARDS];
+
+    static unsigned int hashOf(const KeyType& key)
+    {
+        unsigned int hasher(const KeyType& k); // prototype
+        return hasher(key);
+    }
+
+      // the shard comes from the hash's low bits and the bucket from the rest, so the two are
+      // independent
+    static int shardOf(unsigned int hash)
+    {
+        return hash % NUM_SHARDS;
+    }
+
+    static int bucketOf(unsigned int hash, int numBuckets)
+    {
+        return (hash / NUM_SHARDS) % numBuckets;
+    }
+
+    static Table* newTable(int numBuckets);
+    static void deleteTable(Table* t, bool withNodes);
+    void grow(Shard& shard);
+    void retire(Shard& shard, Node* node, Table* table);
+    void reclaim(Shard& shard, bool force);
+};
+
+template<typename KeyType, typename ValueType>
+ConcurrentHashMap<KeyType, ValueType>::ConcurrentHashMap(double maximumLoadFactor)
+{
+    m_maxLoadFactor = maximumLoadFactor;
+    for(int s = 0; s < NUM_SHARDS; s++){
+        m_shards[s].table.store(newTable(8), std::memory_order_relaxed);   // 8 buckets, like ExpandableHashMap
+        m_shards[s].numAssociations = 0;
+    }
+}
+
+template<typename KeyType, typename ValueType>
+ConcurrentHashMap<KeyType, ValueType>::~ConcurrentHashMap()
+{
+    for(int s = 0; s < NUM_SHARDS; s++){
+        reclaim(m_shards[s], true);
+        deleteTable(m_shards[s].table.load(std::memory_order_relaxed), true);
+    }
+}
+
+// frees everything, retired entries included, and goes back to 8 empty buckets per shard
+template<typename KeyType, typename ValueType>
+void ConcurrentHashMap<KeyType, ValueType>::reset()
+{
+    for(int s = 0; s < NUM_SHARDS; s++){
+        Shard& shard = m_shards[s];
+        reclaim(shard, true);
+        deleteTable(shard.table.load(std::memory_order_relaxed), true);
+        shard.table.store(newTable(8), std::memory_order_release);
+        shard.numAssociations = 0;
+    }
+}
+
+// a snapshot: other threads may be adding keys while the shards are added up
+template<typename KeyType, typename ValueType>
+int ConcurrentHashMap<KeyType, ValueType>::size() const
+{
+    int total = 0;
+    for(int s = 0; s < NUM_SHARDS; s++){
+        std::lock_guard<std::mutex> guard(m_shards[s].lock);
+        total += m_shards[s].numAssociations;
+    }
+    return total;
+}
+
+template<typename KeyType, typename ValueType>
+size_t ConcurrentHashMap<KeyType, ValueType>::bytesUsed() const
+{
+    size_t bytes = sizeof(*this);
+    for(int s = 0; s < NUM_SHARDS; s++){
+        const Shard& shard = m_shards[s];
+        std::lock_guard<std::mutex> guard(shard.lock);
+        const Table* t = shard.table.load(std::memory_order_acquire);
+        bytes += sizeof(Table) + t->numBuckets * sizeof(std::atomic<Node*>) + size_t(shard.numAssociations) * sizeof(Node);
+        for(int i = 0; i < shard.retired.size(); i++){
+            const Retired& r = shard.retired[i];
+            bytes += r.node ? sizeof(Node) : sizeof(Table) + r.table->numBuckets * sizeof(std::atomic<Node*>);
+        }
+        bytes += shard.retired.capacity() * sizeof(Retired);
+    }
+    return bytes;
+}
+
+// Replacing a value swaps a new entry in for the old one with a single store, so a reader sees
+// one or the other, never a value half written.
+template<typename KeyType, typename ValueType>
+void ConcurrentHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
+{
+    unsigned int hash = hashOf(key);
+    Shard& shard = m_shards[shardOf(hash)];
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    Table* t = shard.table.load(std::memory_order_relaxed);
+    std::atomic<Node*>* link = &t->buckets[bucketOf(hash, t->numBuckets)];
+    for(Node* n = link->load(std::memory_order_relaxed); n != nullptr; n = n->next.load(std::memory_order_relaxed)){
+        if(n->hash == hash && n->k == key){   // if key already in map, update
+            Node* replacement = new Node;
+            replacement->k = key;
+            replacement->v = value;
+            replacement->hash = hash;
+            replacement->next.store(n->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            link->store(replacement, std::memory_order_release);
+            retire(shard, n, nullptr);
+            return;
+        }
+        link = &n->next;
+    }
+
+    // same load factor rule as ExpandableHashMap, per shard
+    if((static_cast<double>(shard.numAssociations) + 1) / t->numBuckets > m_maxLoadFactor){
+        grow(shard);
+        t = shard.table.load(std::memory_order_relaxed);
+    }
+    std::atomic<Node*>& bucket = t->buckets[bucketOf(hash, t->numBuckets)];
+    Node* newNode = new Node;
+    newNode->k = key;
+    newNode->v = value;
+    newNode->hash = hash;
+    newNode->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    bucket.store(newNode, std::memory_order_release);
+    shard.numAssociations++;
+}
+
+template<typename KeyType, typename ValueType>
+bool ConcurrentHashMap<KeyType, ValueType>::find(const KeyType& key, ValueType& value) const
+{
+    unsigned int hash = hashOf(key);
+    const Shard& shard = m_shards[shardOf(hash)];
+    ReadEpochs& epochs = ReadEpochs::instance();
+    epochs.enter();
+    const Table* t = shard.table.load(std::memory_order_acquire);
+    const Node* n = t->buckets[bucketOf(hash, t->numBuckets)].load(std::memory_order_acquire);
+    for(; n != nullptr; n = n->next.load(std::memory_order_acquire)){
+        if(n->hash == hash && n->k == key){
+            value = n->v;
+            epochs.exit();
+            return true;
+        }
+    }
+    epochs.exit();
+    return false;
+}
+
+template<typename KeyType, typename ValueType>
+typename ConcurrentHashMap<KeyType, ValueType>::Table* ConcurrentHashMap<KeyType, ValueType>::newTable(int numBuckets)
+{
+    Table* t = new Table;
+    t->numBuckets = numBuckets;
+    t->buckets = new std::atomic<Node*>[numBuckets];
+    for(int i = 0; i < numBuckets; i++)
+        t->buckets[i].store(nullptr, std::memory_order_relaxed);
+    return t;
+}
+
+template<typename KeyType, typename ValueType>
+void ConcurrentHashMap<KeyType, ValueType>::deleteTable(Table* t, bool withNodes)
+{
+    if(withNodes){
+        for(int i = 0; i < t->numBuckets; i++){
+            Node* n = t->buckets[i].load(std::memory_order_relaxed);
+            while(n != nullptr){
+                Node* next = n->next.load(std::memory_order_relaxed);
+                delete n;
+                n = next;
+            }
+        }
+    }
+    delete[] t->buckets;
+    delete t;
+}
+
+// Readers may be partway down the old chains, so the entries are copied into a table twice the
+// size rather than relinked, and the old table goes with its entries once nobody can be in it.
+template<typename KeyType, typename ValueType>
+void ConcurrentHashMap<KeyType, ValueType>::grow(Shard& shard)
+{
+    Table* old = shard.table.load(std::memory_order_relaxed);
+    Table* t = newTable(old->numBuckets * 2);
+    for(int i = 0; i < old->numBuckets; i++){
+        for(Node* n = old->buckets[i].load(std::memory_order_relaxed); n != nullptr; n = n->next.load(std::memory_order_relaxed)){
+            Node* copy = new Node;
+            copy->k = n->k;
+            copy->v = n->v;
+            copy->hash = n->hash;
+            std::atomic<Node*>& bucket = t->buckets[bucketOf(n->hash, t->numBuckets)];
+            copy->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            bucket.store(copy, std::memory_order_relaxed);
+        }
+    }
+    shard.table.store(t, std::memory_order_release);
+    retire(shard, nullptr, old);
+}
+
+template<typename KeyType, typename ValueType>
+void ConcurrentHashMap<KeyType, ValueType>::retire(Shard& shard, Node* node, Table* table)
+{
+    Retired r;
+    r.epoch = ReadEpochs::instance().advance();
+    r.node = node;
+    r.table = table;
+    shard.retired.push_back(r);
+    if(shard.retired.size() >= RECLAIM_BATCH)
+        reclaim(shard, false);
+}
+
+// frees what no reader can still be looking at, or with force everything, when nobody can be
+template<typename KeyType, typename ValueType>
+void ConcurrentHashMap<KeyType, ValueType>::reclaim(Shard& shard, bool force)
+{
+    unsigned long long oldest = force ? ReadEpochs::IDLE : ReadEpochs::instance().oldestReader();
+    int kept = 0;
+    for(int i = 0; i < shard.retired.size(); i++){
+        Retired& r = shard.retired[i];
+        if(r.epoch >= oldest){
+            shard.retired[kept++] = r;
+            continue;
+        }
+        if(r.node)
+            delete r.node;
+        else
+            deleteTable(r.table, true);
+    }
+    shard.retired.resize(kept);
+}
+
+#endif // CONCURRENTHASHMAP_INCLUDED
@@ -0,0 +1,121 @@
+#include "provided.h"
+#include "MemoryAccounting.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+using namespace std;
+
+// Strings live in fixed-size chunks that are never moved or freed, so a reader can index them
+// while another thread interns a new string.  Only interning takes the lock.
+class CommandStringTable
+{
+public:
+    CommandStringTable()
+     : m_count(0)
+    {
+        for (int i = 0; i < MAX_CHUNKS; i++)
+            m_chunks[i].store(nullptr, memory_order_relaxed);
+    }
+
+    int intern(const string& s)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        unordered_map<string, int>::const_iterator it = m_ids.find(s);
+        if (it != m_ids.end())
+            return it->second;
+        int id = m_count;
+        if (id / CHUNK_SIZE >= MAX_CHUNKS)
+        {
+            // every id handed out is still referenced, so there is nothing to give back
+            cerr << "Command string table is full (" << id << " strings)" << endl;
+            abort();
+        }
+        if (id % CHUNK_SIZE == 0)
+            m_chunks[id / CHUNK_SIZE].store(new string[CHUNK_SIZE], memory_order_release);
+        m_chunks[id / CHUNK_SIZE].load(memory_order_relaxed)[id % CHUNK_SIZE] = s;
+        m_ids[s] = id;
+        m_count++;
+        return id;
+    }
+
+      // id must have come from intern(), on this thread or passed along after it returned
+    const string& get(int id) const
+    {
+        return m_chunks[id / CHUNK_SIZE].load(memory_order_acquire)[id % CHUNK_SIZE];
+    }
+
+    // the chunk pointers, every chunk handed out, the strings' own allocations, and the index:
+    // a node per entry with its copy of the string, plus the bucket array
+    size_t bytesUsed() const
+    {
+        lock_guard<mutex> lock(m_mutex);
+        size_t bytes = sizeof(m_chunks) + size_t((m_count + CHUNK_SIZE - 1) / CHUNK_SIZE) * CHUNK_SIZE * sizeof(string);
+        for (unordered_map<string, int>::const_iterator it = m_ids.begin(); it != m_ids.end(); it++)
+            bytes += 2 * stringHeapBytes(it->first) + sizeof(void*) + sizeof(pair<const string, int>) + sizeof(size_t);
+        return bytes + m_ids.bucket_count() * sizeof(void*);
+    }
+
+private:
+    static const int CHUNK_SIZE = 1024;
+    static const int MAX_CHUNKS = 1 << 16;   // 64M distinct strings
+
+    atomic<string*>            m_chunks[MAX_CHUNKS];
+    mutable mutex              m_mutex;
+    unordered_map<string, int> m_ids;
+    int                        m_count;
+};
+
+static CommandStringTable& commandStrings()
+{
+    static CommandStringTable table;
+    return table;
+}
+
+int internCommandString(const string& s)
+{
+    return commandStrings().intern(s);
+}
+
+const string& commandString(int id)
+{
+    return commandStrings().get(id);
+}
+
+size_t commandStringBytes()
+{
+    return commandStrings().bytesUsed();
+}
+
+struct DeliveryCommand::ItemText
+{
+    explicit ItemText(string s)
+     : text(std::move(s)), refs(1)
+    {}
+
+    string      text;
+    atomic<int> refs;
+};
+
+DeliveryCommand::ItemText* DeliveryCommand::newItemText(string item)
+{
+    return new ItemText(std::move(item));
+}
+
+void DeliveryCommand::retainItemText(ItemText* item)
+{
+    item->refs.fetch_add(1, memory_order_relaxed);
+}
+
+void DeliveryCommand::releaseItemText(ItemText* item)
+{
+    if (item->refs.fetch_sub(1, memory_order_acq_rel) == 1)
+        delete item;
+}
+
+const string& DeliveryCommand::itemText(const ItemText* item)
+{
+    return item->text;
+}
@@ -0,0 +1,116 @@
+#include "DeliveryIO.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+using namespace std;
+
+// whether text is a whole finite number, so GeoCoord's stod can't throw on it
+static bool isCoordinate(const string& text)
+{
+    if (text.empty())
+        return false;
+    const char* begin = text.c_str();
+    char* end;
+    double value = strtod(begin, &end);
+    return end == begin + text.size() && isfinite(value);
+}
+
+bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v)
+{
+    ifstream inf(deliveriesFile);
+    if (!inf)
+        return false;
+    return readDeliveryRequests(inf, depot, v, cout);
+}
+
+bool readDeliveryRequests(istream& in, GeoCoord& depot, vector<DeliveryRequest>& v, ostream& diagnostics)
+{
+    string lat;
+    string lon;
+    in >> lat >> lon;
+    in.ignore(10000, '\n');
+    bool valid = isCoordinate(lat) && isCoordinate(lon);
+    if (valid)
+        depot = GeoCoord(lat, lon);
+    else
+        diagnostics << "Bad depot coordinates: " << lat << " " << lon << endl;
+    string line;
+    while (getline(in, line))
+    {
+        string item;
+        if (!parseDelivery(line, lat, lon, item, diagnostics))
+            continue;
+        if (isCoordinate(lat) && isCoordinate(lon))
+            v.push_back(DeliveryRequest(item, GeoCoord(lat, lon)));
+        else
+        {
+            diagnostics << "Bad coordinates in deliveries file line: " << line << endl;
+            valid = false;
+        }
+    }
+    return valid;
+}
+
+bool parseDelivery(string line, string& lat, string& lon, string& item, ostream& diagnostics)
+{
+    const size_t colon = line.find(':');
+    if (colon == string::npos)
+    {
+        diagnostics << "Missing colon in deliveries file line: " << line << endl;
+        return false;
+    }
+    istringstream iss(line.substr(0, colon));
+    if (!(iss >> lat >> lon))
+    {
+        diagnostics << "Bad format in deliveries file line: " << line << endl;
+        return false;
+    }
+    item = line.substr(colon + 1);
+    if (item.empty())
+    {
+        diagnostics << "Missing item in deliveries file line: " << line << endl;
+        return false;
+    }
+    return true;
+}
+
+bool formatDeliveryPlan(string& buffer, DeliveryResult result, const vector<DeliveryCommand>& commands, double totalMiles)
+{
+    if (result == BAD_COORD)
+    {
+        buffer += "One or more depot or delivery coordinates are invalid.\n";
+        return false;
+    }
+    if (result == NO_ROUTE)
+    {
+        buffer += "No route can be found to deliver all items.\n";
+        return false;
+    }
+    if (result == OVER_CAPACITY)
+    {
+        buffer += "The vehicles can't carry all of the items.\n";
+        return false;
+    }
+    buffer += "Starting at the depot...\n";
+    for (const auto& dc : commands)
+    {
+        dc.appendDescription(buffer);
+        buffer += '\n';
+    }
+    buffer += "You are back at the depot and your deliveries are done!\n";
+    char miles[32];
+    snprintf(miles, sizeof(miles), "%.2f", totalMiles);
+    buffer += miles;
+    buffer += " miles travelled for all deliveries.\n";
+    return true;
+}
+
+bool writeDeliveryPlan(ostream& out, DeliveryResult result, const vector<DeliveryCommand>& commands, double totalMiles)
+{
+    string buffer;
+    bool succeeded = formatDeliveryPlan(buffer, result, commands, totalMiles);
+    out.write(buffer.data(), buffer.size());
+    out.flush();
+    return succeeded;
+}
@@ -0,0 +1,33 @@
+// DeliveryIO.h
+
+// Reading delivery request files and writing finished plans.  main.cpp, the batch driver and
+// anything else that takes delivery files share these so they all accept the same format: the
+// depot's "lat lon" on the first line, then one "lat lon:item" line per delivery.
+
+#ifndef DELIVERYIO_INCLUDED
+#define DELIVERYIO_INCLUDED
+
+#include "provided.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+  // False if the file can't be opened or its coordinates aren't all numbers.
+bool loadDeliveryRequests(std::string deliveriesFile, GeoCoord& depot, std::vector<DeliveryRequest>& v);
+
+  // Same, from any stream.  Lines that don't parse are reported to diagnostics and skipped.
+  // Coordinates that aren't numbers are reported too, and make this return false: the request
+  // should be answered as BAD_COORD rather than planned without them.
+bool readDeliveryRequests(std::istream& in, GeoCoord& depot, std::vector<DeliveryRequest>& v, std::ostream& diagnostics);
+
+bool parseDelivery(std::string line, std::string& lat, std::string& lon, std::string& item, std::ostream& diagnostics);
+
+  // Appends a plan the way main.cpp prints it, or the message for a failed result, to buffer.
+  // Returns whether the plan succeeded.  Reusing one buffer across plans avoids allocating
+  // once it has grown to fit.
+bool formatDeliveryPlan(std::string& buffer, DeliveryResult result, const std::vector<DeliveryCommand>& commands, double totalMiles);
+
+  // The same, written to out in one piece.
+bool writeDeliveryPlan(std::ostream& out, DeliveryResult result, const std::vector<DeliveryCommand>& commands, double totalMiles);
+
+#endif // DELIVERYIO_INCLUDED
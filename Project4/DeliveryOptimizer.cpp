@@ -1,7 +1,788 @@
 #include "provided.h"
 #include <vector>
+#include <deque>
+#include <algorithm>
+#include <bitset>
+#include <thread>
+#include <random>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cmath>
+#include "ThreadPool.h"
+#include "Trace.h"
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 using namespace std;
 
+// Distances between the stops of one optimization run.  Stop 0 is the depot and stop k is
+// deliveries[k-1] as passed in.  Costs come from the caller's road distance matrix when there
+// is one and are crow distances otherwise; either way they are assumed symmetric, which holds
+// for this map since every street segment can be travelled in both directions.
+class StopDistances
+{
+public:
+    StopDistances(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries, const vector<vector<double>>* roadDistances)
+    {
+        m_locations.push_back(&depot);
+        for(int i = 0; i < deliveries.size(); i++)
+            m_locations.push_back(&deliveries[i].location);
+        m_road = roadDistances;
+    }
+    
+    int size() const
+    {
+        return m_locations.size();
+    }
+    
+    double operator()(int from, int to) const
+    {
+        if(m_road)
+            return (*m_road)[from][to];
+        return distanceEarthMiles(*m_locations[from], *m_locations[to]);
+    }
+    
+    bool hasRoadDistances() const
+    {
+        return m_road != nullptr;
+    }
+    
+    const GeoCoord& location(int stop) const
+    {
+        return *m_locations[stop];
+    }
+    
+private:
+    vector<const GeoCoord*> m_locations;
+    const vector<vector<double>>* m_road;
+};
+
+// Writes the closed tour `cycle` into tour starting at the depot, travelling in whichever
+// direction makes the longer of the depot's two legs the trip home.
+static void orientFromDepot(const StopDistances& dist, const vector<int>& cycle, vector<int>& tour)
+{
+    int size = cycle.size();
+    int depotPos = find(cycle.begin(), cycle.end(), 0) - cycle.begin();
+    int after = cycle[(depotPos + 1) % size];
+    int before = cycle[(depotPos + size - 1) % size];
+    bool forward = dist(0, after) <= dist(0, before);
+    tour.resize(size);
+    for(int i = 0; i < size; i++){
+        if(forward)
+            tour[i] = cycle[(depotPos + i) % size];
+        else
+            tour[i] = cycle[(depotPos - i + size) % size];
+    }
+}
+
+// Exact Held-Karp dynamic program over the closed tour, for batches small enough that 2^n * n
+// table entries fit comfortably.  best(S, j) is the cheapest path leaving the depot, visiting
+// exactly the stops in S and ending at j; it is stored as floats in rows of `stride` entries
+// (n rounded up to a multiple of 4), with stops outside S left at infinity, so each
+// best(S, j) = min over k of best(S - j, k) + dist(k, j) is a straight min-plus reduction of
+// two contiguous rows.  All subsets with the same number of stops are independent, so each
+// such layer can be split across threads.
+class ExactTourSolver
+{
+public:
+    ExactTourSolver(const StopDistances& dist, int numThreads);
+    void solve(vector<int>& tour);   // tour[0] is the depot on return
+    
+private:
+    const StopDistances& m_dist;
+    int m_numStops;           // not counting the depot
+    int m_stride;
+    int m_numThreads;
+    vector<float> m_best;     // row S holds best(S, k) for every stop k
+    vector<float> m_into;     // row j holds dist(k, j) for every stop k
+    
+    void fillLayer(const vector<int>& masks, int first, int last);
+    float minPlus(const float* row, const float* into) const;
+    int argMinPlus(const float* row, const float* into) const;
+};
+
+static const float NO_PATH = 1e30f;   // finite, so adding a distance to it can't overflow
+
+ExactTourSolver::ExactTourSolver(const StopDistances& dist, int numThreads)
+ : m_dist(dist)
+{
+    m_numStops = dist.size() - 1;
+    m_stride = (m_numStops + 3) & ~3;
+    m_numThreads = max(numThreads, 1);
+}
+
+void ExactTourSolver::solve(vector<int>& tour)
+{
+    int n = m_numStops;
+    int numMasks = 1 << n;
+    m_best.assign((size_t)numMasks * m_stride, NO_PATH);
+    m_into.assign((size_t)n * m_stride, NO_PATH);
+    for(int j = 0; j < n; j++){
+        for(int k = 0; k < n; k++)
+            m_into[j * m_stride + k] = m_dist(k + 1, j + 1);
+        m_best[(size_t)(1 << j) * m_stride + j] = m_dist(0, j + 1);
+    }
+    
+    vector<vector<int>> layers(n + 1);
+    for(int mask = 1; mask < numMasks; mask++)
+        layers[bitset<32>(mask).count()].push_back(mask);
+    
+    for(int size = 2; size <= n; size++){
+        const vector<int>& masks = layers[size];
+        int numThreads = min(m_numThreads, (int)masks.size() / 256 + 1);   // small layers aren't worth a thread
+        if(numThreads <= 1){
+            fillLayer(masks, 0, masks.size());
+            continue;
+        }
+        vector<thread> workers;
+        int chunk = (masks.size() + numThreads - 1) / numThreads;
+        for(int t = 0; t < numThreads; t++){
+            int first = t * chunk;
+            int last = min((int)masks.size(), first + chunk);
+            if(first < last)
+                workers.push_back(thread(&ExactTourSolver::fillLayer, this, cref(masks), first, last));
+        }
+        for(int t = 0; t < workers.size(); t++)
+            workers[t].join();
+    }
+    
+    // close the tour back at the depot, then walk the table backwards to recover the order
+    int full = numMasks - 1;
+    int last = 0;
+    float bestTotal = NO_PATH;
+    for(int j = 0; j < n; j++){
+        float total = m_best[(size_t)full * m_stride + j] + (float)m_dist(j + 1, 0);
+        if(total < bestTotal){
+            bestTotal = total;
+            last = j;
+        }
+    }
+    
+    vector<int> cycle;
+    int mask = full;
+    int j = last;
+    while(true){
+        cycle.push_back(j + 1);
+        int prev = mask ^ (1 << j);
+        if(prev == 0)
+            break;
+        j = argMinPlus(&m_best[(size_t)prev * m_stride], &m_into[j * m_stride]);
+        mask = prev;
+    }
+    cycle.push_back(0);
+    std::reverse(cycle.begin(), cycle.end());
+    orientFromDepot(m_dist, cycle, tour);
+}
+
+void ExactTourSolver::fillLayer(const vector<int>& masks, int first, int last)
+{
+    for(int i = first; i < last; i++){
+        int mask = masks[i];
+        float* row = &m_best[(size_t)mask * m_stride];
+        for(int j = 0; j < m_numStops; j++){
+            if(mask & (1 << j))
+                row[j] = minPlus(&m_best[(size_t)(mask ^ (1 << j)) * m_stride], &m_into[j * m_stride]);
+        }
+    }
+}
+
+float ExactTourSolver::minPlus(const float* row, const float* into) const
+{
+#if defined(__SSE__)
+    __m128 best = _mm_set1_ps(NO_PATH);
+    for(int k = 0; k < m_stride; k += 4)
+        best = _mm_min_ps(best, _mm_add_ps(_mm_loadu_ps(row + k), _mm_loadu_ps(into + k)));
+    float lanes[4];
+    _mm_storeu_ps(lanes, best);
+    return min(min(lanes[0], lanes[1]), min(lanes[2], lanes[3]));
+#elif defined(__ARM_NEON)
+    float32x4_t best = vdupq_n_f32(NO_PATH);
+    for(int k = 0; k < m_stride; k += 4)
+        best = vminq_f32(best, vaddq_f32(vld1q_f32(row + k), vld1q_f32(into + k)));
+    float lanes[4];
+    vst1q_f32(lanes, best);
+    return min(min(lanes[0], lanes[1]), min(lanes[2], lanes[3]));
+#else
+    float best = NO_PATH;
+    for(int k = 0; k < m_stride; k++)
+        best = min(best, row[k] + into[k]);
+    return best;
+#endif
+}
+
+// the same reduction, done one lane at a time to find which stop the minimum came from
+int ExactTourSolver::argMinPlus(const float* row, const float* into) const
+{
+    int bestStop = 0;
+    float best = NO_PATH;
+    for(int k = 0; k < m_numStops; k++){
+        float cost = row[k] + into[k];
+        if(cost < best){
+            best = cost;
+            bestStop = k;
+        }
+    }
+    return bestStop;
+}
+
+// Each stop's K nearest other stops, closest first; the candidate lists for local search.
+// k-d tree over the stops' positions on the unit sphere.  The straight-line distance between
+// two points on the sphere grows with their great-circle distance, so the nearest stops in the
+// tree are also the nearest by crow distance.  Stops can be removed, and subtrees with nothing
+// left in them are skipped, so a nearest neighbor walk over n stops costs about O(n log n).
+// The tree is implicit: the node for a range [lo, hi) of m_order is its middle element.
+class StopTree
+{
+public:
+    StopTree(const StopDistances& dist);
+    int nearest(int from) const;   // nearest stop still in the tree to stop from, -1 if none
+    void nearest(int from, int k, vector<int>& stops) const;   // up to k, closest first
+    void remove(int stop);
+    
+private:
+    struct Point
+    {
+        double c[3];
+    };
+    
+    vector<Point> m_points;         // by stop
+    vector<int>   m_order;          // stops in tree order
+    vector<int>   m_position;       // stop -> index into m_order
+    vector<char>  m_axis;           // split axis of the node at each index
+    vector<int>   m_alive;          // stops left in the subtree of the node at each index
+    vector<bool>  m_removed;        // by stop
+    mutable vector<pair<double, int>> m_best;   // max-heap of the current query's candidates
+    
+    void build(int lo, int hi);
+    void search(int lo, int hi, const Point& q, int exclude, int k) const;
+};
+
+StopTree::StopTree(const StopDistances& dist)
+{
+    int size = dist.size();
+    const double toRadians = 3.14159265358979323846 / 180;
+    m_points.resize(size);
+    for(int stop = 0; stop < size; stop++){
+        double lat = dist.location(stop).latitude * toRadians;
+        double lon = dist.location(stop).longitude * toRadians;
+        m_points[stop].c[0] = cos(lat) * cos(lon);
+        m_points[stop].c[1] = cos(lat) * sin(lon);
+        m_points[stop].c[2] = sin(lat);
+        m_order.push_back(stop);
+    }
+    m_axis.resize(size);
+    m_alive.resize(size);
+    m_removed.assign(size, false);
+    build(0, size);
+    m_position.resize(size);
+    for(int i = 0; i < size; i++)
+        m_position[m_order[i]] = i;
+}
+
+// splits each range at the median along the axis its points spread furthest on
+void StopTree::build(int lo, int hi)
+{
+    if(lo >= hi)
+        return;
+    int axis = 0;
+    double widest = -1;
+    for(int a = 0; a < 3; a++){
+        double low = m_points[m_order[lo]].c[a], high = low;
+        for(int i = lo + 1; i < hi; i++){
+            low = min(low, m_points[m_order[i]].c[a]);
+            high = max(high, m_points[m_order[i]].c[a]);
+        }
+        if(high - low > widest){
+            widest = high - low;
+            axis = a;
+        }
+    }
+    int mid = (lo + hi) / 2;
+    nth_element(m_order.begin() + lo, m_order.begin() + mid, m_order.begin() + hi, [this, axis](int a, int b) {
+        return m_points[a].c[axis] < m_points[b].c[axis];
+    });
+    m_axis[mid] = axis;
+    m_alive[mid] = hi - lo;
+    build(lo, mid);
+    build(mid + 1, hi);
+}
+
+int StopTree::nearest(int from) const
+{
+    m_best.clear();
+    search(0, m_order.size(), m_points[from], from, 1);
+    return m_best.empty() ? -1 : m_best.front().second;
+}
+
+void StopTree::nearest(int from, int k, vector<int>& stops) const
+{
+    m_best.clear();
+    search(0, m_order.size(), m_points[from], from, k);
+    sort_heap(m_best.begin(), m_best.end());
+    stops.clear();
+    for(int i = 0; i < m_best.size(); i++)
+        stops.push_back(m_best[i].second);
+}
+
+void StopTree::remove(int stop)
+{
+    if(m_removed[stop])
+        return;
+    m_removed[stop] = true;
+    int lo = 0, hi = m_order.size(), pos = m_position[stop];
+    for(;;){
+        int mid = (lo + hi) / 2;
+        m_alive[mid]--;
+        if(pos == mid)
+            return;
+        if(pos < mid)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+}
+
+void StopTree::search(int lo, int hi, const Point& q, int exclude, int k) const
+{
+    if(lo >= hi)
+        return;
+    int mid = (lo + hi) / 2;
+    if(m_alive[mid] == 0)
+        return;
+    
+    int stop = m_order[mid];
+    const Point& p = m_points[stop];
+    if(!m_removed[stop] && stop != exclude){
+        double dx = q.c[0] - p.c[0], dy = q.c[1] - p.c[1], dz = q.c[2] - p.c[2];
+        pair<double, int> candidate(dx * dx + dy * dy + dz * dz, stop);
+        if(m_best.size() < k){
+            m_best.push_back(candidate);
+            push_heap(m_best.begin(), m_best.end());
+        }
+        else if(candidate < m_best.front()){
+            pop_heap(m_best.begin(), m_best.end());
+            m_best.back() = candidate;
+            push_heap(m_best.begin(), m_best.end());
+        }
+    }
+    
+    // the side q is on first; the other only if the splitting plane is closer than the worst kept
+    int axis = m_axis[mid];
+    double diff = q.c[axis] - p.c[axis];
+    if(diff < 0){
+        search(lo, mid, q, exclude, k);
+        if(m_best.size() < k || diff * diff <= m_best.front().first)
+            search(mid + 1, hi, q, exclude, k);
+    }
+    else{
+        search(mid + 1, hi, q, exclude, k);
+        if(m_best.size() < k || diff * diff <= m_best.front().first)
+            search(lo, mid, q, exclude, k);
+    }
+}
+
+static void buildNeighborLists(const StopDistances& dist, int numNeighbors, vector<vector<int>>& neighbors)
+{
+    int size = dist.size();
+    int k = min(numNeighbors, size - 1);
+    neighbors.assign(size, vector<int>());
+    if(!dist.hasRoadDistances()){
+        StopTree tree(dist);
+        for(int a = 0; a < size; a++)
+            tree.nearest(a, k, neighbors[a]);
+        return;
+    }
+    for(int a = 0; a < size; a++){
+        vector<pair<double, int>> byDistance;
+        for(int b = 0; b < size; b++){
+            if(b != a)
+                byDistance.push_back(pair<double, int>(dist(a, b), b));
+        }
+        partial_sort(byDistance.begin(), byDistance.begin() + k, byDistance.end());
+        for(int i = 0; i < k; i++)
+            neighbors[a].push_back(byDistance[i].second);
+    }
+}
+
+static double tourCost(const StopDistances& dist, const vector<int>& cycle)
+{
+    double cost = 0;
+    for(int i = 0; i < cycle.size(); i++)
+        cost += dist(cycle[i], cycle[(i + 1) % cycle.size()]);
+    return cost;
+}
+
+// Local search over a closed tour (depot -> every stop -> depot) with 2-opt and Or-opt moves.
+// Moves are only tried against each stop's K nearest stops, and a stop is only re-examined
+// once a move has touched it (don't-look bits), so a pass costs about O(n*K) instead of O(n^2).
+class TourImprover
+{
+public:
+    TourImprover(const StopDistances& dist, const vector<vector<int>>& neighbors);
+    void improve(vector<int>& tour);   // tour[0] is the depot, both on entry and on return
+    
+      // the pieces of improve(), for searches that keep kicking the same tour
+    void load(const vector<int>& cycle, double cost);
+    void localSearch();
+    void kick(mt19937& rng);           // random double bridge; wakes the stops it touched
+    
+    static const int MIN_KICK_SIZE = 8;   // smallest cycle, depot included, a kick changes
+    
+    double cost() const
+    {
+        return m_cost;
+    }
+    
+    const vector<int>& cycle() const
+    {
+        return m_tour;
+    }
+    
+private:
+    const StopDistances& m_dist;
+    const vector<vector<int>>& m_neighbors;
+    int m_size;
+    double m_cost;                     // length of the closed tour in m_tour
+    vector<int> m_tour;                // cyclic; the depot may move around while improving
+    vector<int> m_pos;                 // stop -> its index in m_tour
+    vector<bool> m_queued;             // a stop that isn't queued has its don't-look bit set
+    deque<int> m_queue;
+    
+    int next(int stop) const
+    {
+        return m_tour[(m_pos[stop] + 1) % m_size];
+    }
+    
+    int prev(int stop) const
+    {
+        return m_tour[(m_pos[stop] + m_size - 1) % m_size];
+    }
+    
+    void wake(int stop);
+    void reverse(int fromPos, int toPos);
+    bool tryTwoOpt(int a);
+    bool tryOrOpt(int a);
+    void moveSegment(int first, int length, int after, bool reversed);
+};
+
+static const double IMPROVEMENT_EPSILON = 1e-10;
+
+TourImprover::TourImprover(const StopDistances& dist, const vector<vector<int>>& neighbors)
+ : m_dist(dist), m_neighbors(neighbors)
+{
+    m_size = dist.size();
+    m_cost = 0;
+}
+
+void TourImprover::improve(vector<int>& tour)
+{
+    if(m_size < 4)   // every order of three or fewer stops is the same closed tour
+        return;
+    
+    load(tour, tourCost(m_dist, tour));
+    for(int i = 0; i < m_size; i++)
+        wake(m_tour[i]);
+    localSearch();
+    orientFromDepot(m_dist, m_tour, tour);
+}
+
+void TourImprover::load(const vector<int>& cycle, double cost)
+{
+    m_tour = cycle;
+    m_cost = cost;
+    m_pos.assign(m_size, 0);
+    for(int i = 0; i < m_size; i++)
+        m_pos[m_tour[i]] = i;
+    m_queued.assign(m_size, false);
+    m_queue.clear();
+}
+
+void TourImprover::localSearch()
+{
+    while(!m_queue.empty()){
+        int a = m_queue.front();
+        m_queue.pop_front();
+        m_queued[a] = false;
+        if(tryTwoOpt(a) || tryOrOpt(a))
+            wake(a);
+    }
+}
+
+// cuts the cycle into A B C D at three random points and reconnects it as A C B D, a change
+// 2-opt and Or-opt can't undo in one step
+void TourImprover::kick(mt19937& rng)
+{
+    if(m_size < MIN_KICK_SIZE)
+        return;
+    
+    int cuts[3];
+    do{
+        for(int i = 0; i < 3; i++)
+            cuts[i] = 1 + rng() % (m_size - 1);
+        sort(cuts, cuts + 3);
+    }while(cuts[0] == cuts[1] || cuts[1] == cuts[2]);
+    
+    int a1 = m_tour[cuts[0] - 1], b0 = m_tour[cuts[0]];
+    int b1 = m_tour[cuts[1] - 1], c0 = m_tour[cuts[1]];
+    int c1 = m_tour[cuts[2] - 1], d0 = m_tour[cuts[2] % m_size];
+    m_cost += m_dist(a1, c0) + m_dist(c1, b0) + m_dist(b1, d0)
+            - m_dist(a1, b0) - m_dist(b1, c0) - m_dist(c1, d0);
+    
+    vector<int> kicked(m_tour.begin(), m_tour.begin() + cuts[0]);
+    kicked.insert(kicked.end(), m_tour.begin() + cuts[1], m_tour.begin() + cuts[2]);
+    kicked.insert(kicked.end(), m_tour.begin() + cuts[0], m_tour.begin() + cuts[1]);
+    kicked.insert(kicked.end(), m_tour.begin() + cuts[2], m_tour.end());
+    m_tour.swap(kicked);
+    for(int i = 0; i < m_size; i++)
+        m_pos[m_tour[i]] = i;
+    
+    int touched[6] = { a1, b0, b1, c0, c1, d0 };
+    for(int i = 0; i < 6; i++)
+        wake(touched[i]);
+}
+
+void TourImprover::wake(int stop)
+{
+    if(!m_queued[stop]){
+        m_queued[stop] = true;
+        m_queue.push_back(stop);
+    }
+}
+
+// reverses the stretch of the cycle running forward from fromPos to toPos, flipping whichever of
+// that stretch and its complement is shorter since both give the same cycle
+void TourImprover::reverse(int fromPos, int toPos)
+{
+    int length = (toPos - fromPos + m_size) % m_size + 1;
+    if(length * 2 > m_size){
+        int newFrom = (toPos + 1) % m_size;
+        toPos = (fromPos - 1 + m_size) % m_size;
+        fromPos = newFrom;
+        length = m_size - length;
+    }
+    for(int k = 0; k < length / 2; k++){
+        int i = (fromPos + k) % m_size;
+        int j = (toPos - k + m_size) % m_size;
+        std::swap(m_tour[i], m_tour[j]);
+        m_pos[m_tour[i]] = i;
+        m_pos[m_tour[j]] = j;
+    }
+}
+
+// replaces edges (a, a's neighbor on one side) and (c, c's neighbor on the same side) with
+// (a, c) and the edge between the two old neighbors
+bool TourImprover::tryTwoOpt(int a)
+{
+    for(int side = 0; side < 2; side++){
+        int aNext = side == 0 ? next(a) : prev(a);
+        double removedA = m_dist(a, aNext);
+        for(int i = 0; i < m_neighbors[a].size(); i++){
+            int c = m_neighbors[a][i];
+            double addedA = m_dist(a, c);
+            if(addedA >= removedA)   // neighbors only get farther, so nothing else can gain
+                break;
+            int cNext = side == 0 ? next(c) : prev(c);
+            if(c == aNext || cNext == a)
+                continue;
+            double delta = addedA + m_dist(aNext, cNext) - removedA - m_dist(c, cNext);
+            if(delta < -IMPROVEMENT_EPSILON){
+                if(side == 0)
+                    reverse(m_pos[aNext], m_pos[c]);
+                else
+                    reverse(m_pos[a], m_pos[cNext]);
+                m_cost += delta;
+                wake(aNext);
+                wake(c);
+                wake(cNext);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// moves the run of 1 to 3 stops starting at a to sit between some c near either end of the
+// run and c's neighbor, in whichever orientation is cheaper
+bool TourImprover::tryOrOpt(int a)
+{
+    for(int length = 1; length <= 3 && length + 2 < m_size; length++){
+        int first = a;
+        int last = m_tour[(m_pos[a] + length - 1) % m_size];
+        int before = prev(first);
+        int after = next(last);
+        double removeGain = m_dist(before, first) + m_dist(last, after) - m_dist(before, after);
+        if(removeGain <= IMPROVEMENT_EPSILON)
+            continue;
+        
+        for(int end = 0; end < 2; end++){
+            int endpoint = end == 0 ? first : last;
+            for(int i = 0; i < m_neighbors[endpoint].size(); i++){
+                int c = m_neighbors[endpoint][i];
+                if(m_dist(endpoint, c) >= removeGain)
+                    break;
+                if((m_pos[c] - m_pos[first] + m_size) % m_size < length)   // c is inside the run
+                    continue;
+                
+                // try the edge after c and the edge before it
+                for(int side = 0; side < 2; side++){
+                    int x = side == 0 ? c : prev(c);
+                    int y = next(x);
+                    if((m_pos[x] - m_pos[first] + m_size) % m_size < length || (m_pos[y] - m_pos[first] + m_size) % m_size < length)
+                        continue;
+                    double asIs = m_dist(x, first) + m_dist(last, y);
+                    double flipped = m_dist(x, last) + m_dist(first, y);
+                    double added = min(asIs, flipped) - m_dist(x, y);
+                    if(removeGain - added > IMPROVEMENT_EPSILON){
+                        moveSegment(first, length, x, flipped < asIs);
+                        m_cost -= removeGain - added;
+                        wake(before);
+                        wake(after);
+                        wake(x);
+                        wake(y);
+                        wake(last);
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void TourImprover::moveSegment(int first, int length, int after, bool reversed)
+{
+    vector<int> segment;
+    for(int k = 0; k < length; k++)
+        segment.push_back(m_tour[(m_pos[first] + k) % m_size]);
+    if(reversed)
+        std::reverse(segment.begin(), segment.end());
+    
+    // walk the rest of the cycle from just past the run, dropping the run back in after `after`
+    vector<int> newTour;
+    newTour.reserve(m_size);
+    int startPos = (m_pos[first] + length) % m_size;
+    for(int k = 0; k < m_size - length; k++){
+        int stop = m_tour[(startPos + k) % m_size];
+        newTour.push_back(stop);
+        if(stop == after)
+            newTour.insert(newTour.end(), segment.begin(), segment.end());
+    }
+    m_tour.swap(newTour);
+    for(int i = 0; i < m_size; i++)
+        m_pos[m_tour[i]] = i;
+}
+
+// Iterated local search against a deadline: every worker repeatedly kicks its tour with a double
+// bridge, re-optimizes around the kick, and keeps the result only if it is shorter.  Worker 0
+// starts from the caller's tour and the rest from shuffled ones, each with its own seed.  The
+// best tour found so far is shared through an atomic pointer to an immutable snapshot, so
+// publishing and reading it never take a lock; a worker that has stalled for a while adopts
+// the shared best if it beats its own.
+class AnytimeTourSearch
+{
+public:
+    AnytimeTourSearch(const StopDistances& dist, const vector<vector<int>>& neighbors, chrono::steady_clock::time_point deadline);
+    void run(vector<int>& tour, int numThreads);   // tour[0] is the depot, both on entry and on return
+    
+private:
+    struct Snapshot{
+        double cost;
+        vector<int> cycle;
+    };
+    
+    static const int STALL_LIMIT = 50;   // kicks without improvement before looking at the shared best
+    static const unsigned SEARCH_SEED = 20200313;
+    
+    const StopDistances& m_dist;
+    const vector<vector<int>>& m_neighbors;
+    chrono::steady_clock::time_point m_deadline;
+    atomic<const Snapshot*> m_best;
+    vector<vector<unique_ptr<Snapshot>>> m_published;   // per worker, freed only once every worker is done
+    
+    void worker(int index, const vector<int>& start);
+    void publish(int index, const vector<int>& cycle, double cost);
+};
+
+AnytimeTourSearch::AnytimeTourSearch(const StopDistances& dist, const vector<vector<int>>& neighbors, chrono::steady_clock::time_point deadline)
+ : m_dist(dist), m_neighbors(neighbors), m_deadline(deadline), m_best(nullptr)
+{
+}
+
+void AnytimeTourSearch::run(vector<int>& tour, int numThreads)
+{
+    // workers past the pool's size would only start once the others hit the deadline
+    ThreadPool& pool = ThreadPool::shared();
+    int numWorkers = numThreads <= 0 ? pool.size() : min(numThreads, pool.size());
+    m_published.resize(numWorkers);
+    {
+        TaskGroup workers(pool);
+        for(int i = 0; i < numWorkers; i++)
+            workers.run([this, i, &tour]() { worker(i, tour); });
+        workers.wait();
+    }
+    
+    const Snapshot* best = m_best.load();
+    if(best && best->cost < tourCost(m_dist, tour))
+        orientFromDepot(m_dist, best->cycle, tour);
+}
+
+void AnytimeTourSearch::worker(int index, const vector<int>& start)
+{
+    mt19937 rng(SEARCH_SEED + index);
+    TourImprover improver(m_dist, m_neighbors);
+    
+    vector<int> current = start;
+    if(index != 0)
+        shuffle(current.begin(), current.end(), rng);
+    improver.improve(current);
+    double currentCost = tourCost(m_dist, current);
+    publish(index, current, currentCost);
+    
+    improver.load(current, currentCost);
+    int sinceImprovement = 0;
+    while(chrono::steady_clock::now() < m_deadline){
+        improver.kick(rng);
+        improver.localSearch();
+        if(improver.cost() < currentCost - IMPROVEMENT_EPSILON){
+            current = improver.cycle();
+            currentCost = improver.cost();
+            publish(index, current, currentCost);
+            sinceImprovement = 0;
+            continue;
+        }
+        
+        sinceImprovement++;
+        const Snapshot* best = m_best.load();
+        if(sinceImprovement >= STALL_LIMIT && best->cost < currentCost - IMPROVEMENT_EPSILON){
+            current = best->cycle;
+            currentCost = best->cost;
+            sinceImprovement = 0;
+        }
+        improver.load(current, currentCost);
+    }
+}
+
+void AnytimeTourSearch::publish(int index, const vector<int>& cycle, double cost)
+{
+    const Snapshot* best = m_best.load();
+    if(best && best->cost <= cost)
+        return;
+    
+    Snapshot* mine = new Snapshot;
+    mine->cost = cost;
+    mine->cycle = cycle;
+    m_published[index].push_back(unique_ptr<Snapshot>(mine));
+    
+    // someone else may publish between the load and the swap; only replace a worse tour
+    while(!best || cost < best->cost){
+        if(m_best.compare_exchange_weak(best, mine))
+            return;
+    }
+}
+
 class DeliveryOptimizerImpl
 {
 public:
@@ -10,17 +791,36 @@ public:
     void optimizeDeliveryOrder(
         const GeoCoord& depot,
         vector<DeliveryRequest>& deliveries,
+        const vector<vector<double>>* roadDistances,
+        double& oldCrowDistance,
+        double& newCrowDistance) const;
+    void optimizeDeliveryOrderWithin(
+        const GeoCoord& depot,
+        vector<DeliveryRequest>& deliveries,
+        double timeBudgetSeconds,
+        int numThreads,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+    void setExactSolverThreshold(int maxStops);
+    void setExactSolverThreads(int numThreads);
     
 private:
+    static const int NUM_NEIGHBORS = 10;     // candidate list length for the local search
+    static const int MAX_EXACT_STOPS = 20;   // 2^20 rows of 20 floats is already 80MB
+    
     const StreetMap* m_sm;
+    int m_exactThreshold;
+    int m_exactThreads;
     double calcCrowsDist(const GeoCoord& depot, vector<DeliveryRequest>& deliveries) const;
+    void applyTour(const vector<int>& tour, vector<DeliveryRequest>& deliveries) const;
+    void buildNearestNeighborTour(const StopDistances& dist, vector<int>& tour) const;
 };
 
 DeliveryOptimizerImpl::DeliveryOptimizerImpl(const StreetMap* sm)
 {
     m_sm = sm;
+    m_exactThreshold = 16;
+    m_exactThreads = 1;
 }
 
 DeliveryOptimizerImpl::~DeliveryOptimizerImpl()
@@ -30,6 +830,7 @@ DeliveryOptimizerImpl::~DeliveryOptimizerImpl()
 void DeliveryOptimizerImpl::optimizeDeliveryOrder(
     const GeoCoord& depot,
     vector<DeliveryRequest>& deliveries,
+    const vector<vector<double>>* roadDistances,
     double& oldCrowDistance,
     double& newCrowDistance) const
 {
@@ -38,41 +839,139 @@ void DeliveryOptimizerImpl::optimizeDeliveryOrder(
     
     if(deliveries.size() <= 0)
         return;
+    TRACE_SPAN(span, "optimizeDeliveryOrder");
+    TRACE_COUNT(span, "stops", deliveries.size());
+    
+    oldCrowDistance = calcCrowsDist(depot, deliveries);
+    
+    // a matrix that doesn't cover every stop can't be used, so fall back to crow distances
+    if(roadDistances && roadDistances->size() != deliveries.size() + 1)
+        roadDistances = nullptr;
+    StopDistances dist(depot, deliveries, roadDistances);
+    
+    vector<int> tour;
+    if(int(deliveries.size()) <= m_exactThreshold){
+        // small enough to solve exactly
+        ExactTourSolver solver(dist, m_exactThreads);
+        solver.solve(tour);
+    }
+    else{
+        // greedy construction, then local search to take out the crossings it leaves behind
+        buildNearestNeighborTour(dist, tour);
+        vector<vector<int>> neighbors;
+        buildNeighborLists(dist, NUM_NEIGHBORS, neighbors);
+        TourImprover improver(dist, neighbors);
+        improver.improve(tour);
+    }
+    
+    applyTour(tour, deliveries);
+    newCrowDistance = calcCrowsDist(depot, deliveries);
+}
+
+void DeliveryOptimizerImpl::optimizeDeliveryOrderWithin(
+    const GeoCoord& depot,
+    vector<DeliveryRequest>& deliveries,
+    double timeBudgetSeconds,
+    int numThreads,
+    double& oldCrowDistance,
+    double& newCrowDistance) const
+{
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(timeBudgetSeconds));
+    
+    // batches the exact solver handles are already optimal, and tours too short for a kick to
+    // change are as good as local search makes them, so there is nothing to spend time on
+    if(int(deliveries.size()) <= m_exactThreshold || int(deliveries.size()) + 1 < TourImprover::MIN_KICK_SIZE){
+        optimizeDeliveryOrder(depot, deliveries, nullptr, oldCrowDistance, newCrowDistance);
+        return;
+    }
     
+    TRACE_SPAN(span, "optimizeDeliveryOrderWithin");
+    TRACE_COUNT(span, "stops", deliveries.size());
     oldCrowDistance = calcCrowsDist(depot, deliveries);
+    StopDistances dist(depot, deliveries, nullptr);
+    vector<int> tour;
+    buildNearestNeighborTour(dist, tour);
+    vector<vector<int>> neighbors;
+    buildNeighborLists(dist, NUM_NEIGHBORS, neighbors);
+    TourImprover improver(dist, neighbors);
+    improver.improve(tour);
+    
+    AnytimeTourSearch search(dist, neighbors, deadline);
+    search.run(tour, numThreads);
     
-    // put delivery location closest to depot in the first slot of deliveries array
-    double closestToDepotDist = distanceEarthMiles(depot, deliveries[0].location);
-    int closestToDepotPos = 0;
-    for(int i = 1; i < deliveries.size(); i++){
-        double distToDepot = distanceEarthMiles(depot, deliveries[i].location);
+    applyTour(tour, deliveries);
+    newCrowDistance = calcCrowsDist(depot, deliveries);
+}
+
+// reorders deliveries to follow tour, whose stop k is deliveries[k-1]
+void DeliveryOptimizerImpl::applyTour(const vector<int>& tour, vector<DeliveryRequest>& deliveries) const
+{
+    vector<DeliveryRequest> ordered;
+    ordered.reserve(deliveries.size());
+    for(int i = 1; i < tour.size(); i++)
+        ordered.push_back(deliveries[tour[i] - 1]);
+    deliveries.swap(ordered);
+}
+
+void DeliveryOptimizerImpl::setExactSolverThreshold(int maxStops)
+{
+    m_exactThreshold = max(0, min(maxStops, int(MAX_EXACT_STOPS)));   // int() copies the constant, which has no definition to bind to
+}
+
+void DeliveryOptimizerImpl::setExactSolverThreads(int numThreads)
+{
+    m_exactThreads = max(numThreads, 1);
+}
+
+// tour[0] is the depot; the rest is the nearest neighbor order of the deliveries
+void DeliveryOptimizerImpl::buildNearestNeighborTour(const StopDistances& dist, vector<int>& tour) const
+{
+    // crow distances: walk a k-d tree, taking each stop out of it once it is in the tour
+    if(!dist.hasRoadDistances()){
+        StopTree tree(dist);
+        tree.remove(0);
+        tour.assign(1, 0);
+        for(int next = tree.nearest(0); next >= 0; next = tree.nearest(next)){
+            tour.push_back(next);
+            tree.remove(next);
+        }
+        return;
+    }
+    
+    // road distances have no coordinates to index, so scan the stops not yet placed
+    tour.clear();
+    for(int stop = 0; stop < dist.size(); stop++)
+        tour.push_back(stop);
+    
+    // put delivery location closest to depot in the first slot after the depot
+    double closestToDepotDist = dist(0, tour[1]);
+    int closestToDepotPos = 1;
+    for(int i = 2; i < tour.size(); i++){
+        double distToDepot = dist(0, tour[i]);
         if(distToDepot < closestToDepotDist){
             closestToDepotDist = distToDepot;
             closestToDepotPos = i;
         }
     }
-    if(closestToDepotPos != 0)
-        std::swap(deliveries[0], deliveries[closestToDepotPos]);
-    
+    if(closestToDepotPos != 1)
+        std::swap(tour[1], tour[closestToDepotPos]);
     
-    // reorganize/optimize route based on crows distances between points
-    for(int i = 0; i < deliveries.size() - 1; i++)
+    // reorganize/optimize route based on distances between points
+    for(int i = 1; i < tour.size() - 1; i++)
     {
-        double closestDist = distanceEarthMiles(deliveries[i].location, deliveries[i+1].location);
+        double closestDist = dist(tour[i], tour[i+1]);
         int closestPos = i + 1;
-        for(int k = i + 2; k < deliveries.size(); k++)
+        for(int k = i + 2; k < tour.size(); k++)
         {
-            double curDist = distanceEarthMiles(deliveries[i].location, deliveries[k].location);
+            double curDist = dist(tour[i], tour[k]);
             if(curDist < closestDist){
                 closestDist= curDist;
                 closestPos = k;
             }
         }
         if(closestPos != i + 1)
-            std::swap(deliveries[i + 1], deliveries[closestPos]);
+            std::swap(tour[i + 1], tour[closestPos]);
     }
-    
-    newCrowDistance = calcCrowsDist(depot, deliveries);
 }
 
 double DeliveryOptimizerImpl::calcCrowsDist(const GeoCoord& depot, vector<DeliveryRequest>& deliveries) const
@@ -105,5 +1004,36 @@ void DeliveryOptimizer::optimizeDeliveryOrder(
         double& oldCrowDistance,
         double& newCrowDistance) const
 {
-    return m_impl->optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance);
+    return m_impl->optimizeDeliveryOrder(depot, deliveries, nullptr, oldCrowDistance, newCrowDistance);
+}
+
+void DeliveryOptimizer::optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        vector<DeliveryRequest>& deliveries,
+        const vector<vector<double>>& roadDistances,
+        double& oldCrowDistance,
+        double& newCrowDistance) const
+{
+    return m_impl->optimizeDeliveryOrder(depot, deliveries, &roadDistances, oldCrowDistance, newCrowDistance);
+}
+
+void DeliveryOptimizer::optimizeDeliveryOrderWithin(
+        const GeoCoord& depot,
+        vector<DeliveryRequest>& deliveries,
+        double timeBudgetSeconds,
+        int numThreads,
+        double& oldCrowDistance,
+        double& newCrowDistance) const
+{
+    return m_impl->optimizeDeliveryOrderWithin(depot, deliveries, timeBudgetSeconds, numThreads, oldCrowDistance, newCrowDistance);
+}
+
+void DeliveryOptimizer::setExactSolverThreshold(int maxStops)
+{
+    m_impl->setExactSolverThreshold(maxStops);
+}
+
+void DeliveryOptimizer::setExactSolverThreads(int numThreads)
+{
+    m_impl->setExactSolverThreads(numThreads);
 }
@@ -1,7 +1,268 @@
 #include "provided.h"
 #include <vector>
+#include <algorithm>
+#include "ThreadPool.h"
+#include "Trace.h"
 using namespace std;
 
+static const double UNREACHABLE = 1e18;           // stands in for a missing road distance
+static const double IMPROVEMENT_EPSILON = 1e-10;
+static const int MAX_IMPROVEMENT_PASSES = 50;
+
+// The stops of a fleet plan split into vehicle routes.  Stops are numbered as in the road
+// distance matrix: depots first, then deliveries.  A route runs from its depot through its
+// stops and back to the same depot.
+class FleetRoutes
+{
+public:
+    FleetRoutes(const vector<vector<double>>& dist, int numDepots, int capacity)
+     : m_dist(dist), m_numDepots(numDepots), m_capacity(capacity)
+    {}
+    
+    void build(const vector<int>& depotOf);
+    bool reduceTo(int numVehicles);
+    void improve();
+    
+    int numRoutes() const { return m_routes.size(); }
+    int depotOf(int r) const { return m_routes[r].depot; }
+    const vector<int>& stopsOf(int r) const { return m_routes[r].stops; }
+    
+private:
+    struct Route
+    {
+        int depot;
+        vector<int> stops;
+    };
+    
+    const vector<vector<double>>& m_dist;
+    int m_numDepots;
+    int m_capacity;
+    vector<Route> m_routes;
+    
+    void savings(int depot, const vector<int>& stops);
+    int prevOf(const Route& route, int pos) const;
+    int nextOf(const Route& route, int pos) const;
+    double removalGain(const Route& route, int pos) const;
+    double cheapestInsertion(const Route& route, int stop, int& position) const;
+    bool relocatePass();
+    bool exchangePass();
+};
+
+// Every delivery goes to the depot it has the shortest round trip with.
+void FleetRoutes::build(const vector<int>& depotOf)
+{
+    m_routes.clear();
+    for(int d = 0; d < m_numDepots; d++){
+        vector<int> stops;
+        for(int i = 0; i < depotOf.size(); i++)
+            if(depotOf[i] == d)
+                stops.push_back(m_numDepots + i);
+        if(!stops.empty())
+            savings(d, stops);
+    }
+}
+
+// Clarke-Wright: start with one route per stop and join the tail of one route to the head of
+// another in order of the distance that saves, as long as the joined route fits in a vehicle.
+void FleetRoutes::savings(int depot, const vector<int>& stops)
+{
+    int n = stops.size();
+    vector<vector<int>> chains(n);
+    vector<int> chainOf(n);
+    for(int i = 0; i < n; i++){
+        chains[i].push_back(i);
+        chainOf[i] = i;
+    }
+    
+    struct Saving
+    {
+        double amount;
+        int from;
+        int to;
+        bool operator<(const Saving& other) const { return amount > other.amount; }
+    };
+    vector<Saving> candidates;
+    for(int i = 0; i < n; i++)
+        for(int j = 0; j < n; j++){
+            if(i == j)
+                continue;
+            const vector<double>& fromRow = m_dist[stops[i]];
+            double amount = fromRow[depot] + m_dist[depot][stops[j]] - fromRow[stops[j]];
+            if(amount > 0)
+                candidates.push_back(Saving{amount, i, j});
+        }
+    stable_sort(candidates.begin(), candidates.end());
+    
+    for(int k = 0; k < candidates.size(); k++){
+        int a = chainOf[candidates[k].from], b = chainOf[candidates[k].to];
+        if(a == b || chains[a].back() != candidates[k].from || chains[b].front() != candidates[k].to)
+            continue;
+        if(chains[a].size() + chains[b].size() > m_capacity)
+            continue;
+        for(int i = 0; i < chains[b].size(); i++){
+            chains[a].push_back(chains[b][i]);
+            chainOf[chains[b][i]] = a;
+        }
+        chains[b].clear();
+    }
+    
+    for(int i = 0; i < n; i++){
+        if(chains[i].empty())
+            continue;
+        Route route;
+        route.depot = depot;
+        for(int j = 0; j < chains[i].size(); j++)
+            route.stops.push_back(stops[chains[i][j]]);
+        m_routes.push_back(route);
+    }
+}
+
+// The stop before and after position pos, counting the depot at both ends.
+int FleetRoutes::prevOf(const Route& route, int pos) const
+{
+    return pos == 0 ? route.depot : route.stops[pos - 1];
+}
+
+int FleetRoutes::nextOf(const Route& route, int pos) const
+{
+    return pos + 1 == route.stops.size() ? route.depot : route.stops[pos + 1];
+}
+
+// distance saved by taking the stop at pos out of the route
+double FleetRoutes::removalGain(const Route& route, int pos) const
+{
+    int a = prevOf(route, pos), b = route.stops[pos], c = nextOf(route, pos);
+    return m_dist[a][b] + m_dist[b][c] - m_dist[a][c];
+}
+
+// cheapest place to put stop into route; position is the index it would take
+double FleetRoutes::cheapestInsertion(const Route& route, int stop, int& position) const
+{
+    double best = UNREACHABLE;
+    position = 0;
+    int prev = route.depot;
+    for(int pos = 0; pos <= route.stops.size(); pos++){
+        int next = pos == route.stops.size() ? route.depot : route.stops[pos];
+        double added = m_dist[prev][stop] + m_dist[stop][next] - m_dist[prev][next];
+        if(added < best){
+            best = added;
+            position = pos;
+        }
+        prev = next;
+    }
+    return best;
+}
+
+// Savings can leave more routes than there are vehicles.  Dissolve the smallest route into
+// the cheapest gaps of the others until it fits; the others always have room because the
+// deliveries fit in the fleet.  False if some stop can only be reached from its own route.
+bool FleetRoutes::reduceTo(int numVehicles)
+{
+    while(m_routes.size() > numVehicles){
+        int smallest = 0;
+        for(int r = 1; r < m_routes.size(); r++)
+            if(m_routes[r].stops.size() < m_routes[smallest].stops.size())
+                smallest = r;
+        Route dissolved = m_routes[smallest];
+        m_routes.erase(m_routes.begin() + smallest);
+        
+        for(int i = 0; i < dissolved.stops.size(); i++){
+            int bestRoute = -1, bestPos = 0;
+            double best = UNREACHABLE;
+            for(int r = 0; r < m_routes.size(); r++){
+                if(m_routes[r].stops.size() >= m_capacity)
+                    continue;
+                int pos;
+                double added = cheapestInsertion(m_routes[r], dissolved.stops[i], pos);
+                if(added < best){
+                    best = added;
+                    bestRoute = r;
+                    bestPos = pos;
+                }
+            }
+            if(bestRoute < 0)
+                return false;
+            m_routes[bestRoute].stops.insert(m_routes[bestRoute].stops.begin() + bestPos, dissolved.stops[i]);
+        }
+    }
+    return true;
+}
+
+// Moves stops between routes while that shortens the fleet's total distance.  The order
+// within each route is left to the optimizer afterwards.
+void FleetRoutes::improve()
+{
+    for(int pass = 0; pass < MAX_IMPROVEMENT_PASSES; pass++){
+        bool improved = relocatePass();
+        improved = exchangePass() || improved;
+        if(!improved)
+            return;
+    }
+}
+
+// moves single stops into the cheapest gap of another route with room
+bool FleetRoutes::relocatePass()
+{
+    bool improved = false;
+    for(int from = 0; from < m_routes.size(); from++){
+        for(int pos = 0; pos < m_routes[from].stops.size(); pos++){
+            int stop = m_routes[from].stops[pos];
+            double gain = removalGain(m_routes[from], pos);
+            int bestRoute = -1, bestPos = 0;
+            double best = gain - IMPROVEMENT_EPSILON;
+            for(int to = 0; to < m_routes.size(); to++){
+                if(to == from || m_routes[to].stops.size() >= m_capacity)
+                    continue;
+                int insertAt;
+                double added = cheapestInsertion(m_routes[to], stop, insertAt);
+                if(added < best){
+                    best = added;
+                    bestRoute = to;
+                    bestPos = insertAt;
+                }
+            }
+            if(bestRoute < 0)
+                continue;
+            m_routes[from].stops.erase(m_routes[from].stops.begin() + pos);
+            m_routes[bestRoute].stops.insert(m_routes[bestRoute].stops.begin() + bestPos, stop);
+            pos--;
+            improved = true;
+        }
+    }
+    
+    // a route emptied by relocation frees its vehicle
+    vector<Route> kept;
+    for(int r = 0; r < m_routes.size(); r++)
+        if(!m_routes[r].stops.empty())
+            kept.push_back(m_routes[r]);
+    m_routes.swap(kept);
+    return improved;
+}
+
+// swaps two stops on different routes, each taking the other's place
+bool FleetRoutes::exchangePass()
+{
+    bool improved = false;
+    for(int r1 = 0; r1 < m_routes.size(); r1++)
+        for(int r2 = r1 + 1; r2 < m_routes.size(); r2++)
+            for(int i = 0; i < m_routes[r1].stops.size(); i++)
+                for(int j = 0; j < m_routes[r2].stops.size(); j++){
+                    Route& a = m_routes[r1];
+                    Route& b = m_routes[r2];
+                    int ap = prevOf(a, i), an = nextOf(a, i), bp = prevOf(b, j), bn = nextOf(b, j);
+                    int x = a.stops[i], y = b.stops[j];
+                    double before = m_dist[ap][x] + m_dist[x][an] + m_dist[bp][y] + m_dist[y][bn];
+                    double after = m_dist[ap][y] + m_dist[y][an] + m_dist[bp][x] + m_dist[x][bn];
+                    if(after < before - IMPROVEMENT_EPSILON){
+                        swap(a.stops[i], b.stops[j]);
+                        improved = true;
+                    }
+                }
+    return improved;
+}
+
+// Planning only reads the planner, its router and optimizer, and the map, so one planner can
+// serve plans for many threads at once.
 class DeliveryPlannerImpl
 {
 public:
@@ -11,17 +272,32 @@ public:
         const GeoCoord& depot,
         const vector<DeliveryRequest>& deliveries,
         vector<DeliveryCommand>& commands,
+        double& totalDistanceTravelled,
+        vector<StreetRoute>* legRoutes) const;
+    DeliveryResult generateFleetPlan(
+        const vector<GeoCoord>& depots,
+        const vector<DeliveryRequest>& deliveries,
+        int numVehicles,
+        int vehicleCapacity,
+        vector<VehiclePlan>& plans,
         double& totalDistanceTravelled) const;
+    void setTurnPenalties(double left, double right, double uTurn);
 private:
+    friend class IncrementalPlannerImpl;
+    
+    const StreetMap*   m_sm;
     PointToPointRouter m_router;
     DeliveryOptimizer  m_optimizer;
     
-    string generateProceedCommand(StreetSegment seg) const;
-    int generateTurnCommand(StreetSegment seg1, StreetSegment seg2) const;
+    DeliveryResult validateDeliveries(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries) const;
+    DeliveryResult planInOrder(const GeoCoord& depot, const vector<DeliveryRequest>& orderedDeliveries, vector<DeliveryCommand>& commands, double& totalDistanceTravelled, vector<StreetRoute>* legRoutes = nullptr, vector<size_t>* legCommandEnds = nullptr) const;
+    void appendLegCommands(const StreetRoute& route, vector<DeliveryCommand>& commands) const;
+    DeliveryCommand::Direction generateProceedCommand(const StreetSegment& seg) const;
+    int generateTurnCommand(const StreetSegment& seg1, const StreetSegment& seg2) const;
 };
 
 DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm)
-: m_router(sm), m_optimizer(sm)
+: m_sm(sm), m_router(sm), m_optimizer(sm)
 {
 }
 
@@ -29,14 +305,29 @@ DeliveryPlannerImpl::~DeliveryPlannerImpl()
 {
 }
 
+void DeliveryPlannerImpl::setTurnPenalties(double left, double right, double uTurn)
+{
+    m_router.setTurnPenalties(left, right, uTurn);
+}
+
 DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
     const GeoCoord& depot,
     const vector<DeliveryRequest>& deliveries,
     vector<DeliveryCommand>& commands,
-    double& totalDistanceTravelled) const
+    double& totalDistanceTravelled,
+    vector<StreetRoute>* legRoutes) const
 {
+    if(legRoutes)
+        legRoutes->clear();
     if(deliveries.size() <= 0)
         return DELIVERY_SUCCESS;
+    TRACE_SPAN(span, "generateDeliveryPlan");
+    TRACE_COUNT(span, "stops", deliveries.size());
+    
+    // reject the whole batch up front if any stop is off the map or unreachable from the depot
+    DeliveryResult batchResult = validateDeliveries(depot, deliveries);
+    if(batchResult != DELIVERY_SUCCESS)
+        return batchResult;
     
     // optimize route
     vector<DeliveryRequest> betterDeliveries;
@@ -46,107 +337,261 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
 
     double ocd, ncd;
     m_optimizer.optimizeDeliveryOrder(depot, betterDeliveries, ocd, ncd);
-    DeliveryRequest returnToDepot("DEPOT", depot);
-    betterDeliveries.push_back(returnToDepot);
-    
-    // plan route
-    GeoCoord curCoord = depot;
-    list<StreetSegment>::iterator curSeg, prevSeg;
+    return planInOrder(depot, betterDeliveries, commands, totalDistanceTravelled, legRoutes);
+}
+
+// Builds a road distance matrix over depots and deliveries, splits the deliveries into vehicle
+// routes with savings and inter-route moves, then orders and routes every vehicle on its own.
+// The matrix rows and the per-vehicle work each run in parallel on the shared pool.
+DeliveryResult DeliveryPlannerImpl::generateFleetPlan(
+    const vector<GeoCoord>& depots,
+    const vector<DeliveryRequest>& deliveries,
+    int numVehicles,
+    int vehicleCapacity,
+    vector<VehiclePlan>& plans,
+    double& totalDistanceTravelled) const
+{
+    plans.clear();
     totalDistanceTravelled = 0;
+    if(deliveries.size() <= 0)
+        return DELIVERY_SUCCESS;
+    TRACE_SPAN(span, "generateFleetPlan");
+    TRACE_COUNT(span, "stops", deliveries.size());
+    TRACE_COUNT(span, "vehicles", numVehicles);
+    if(depots.empty() || numVehicles <= 0 || vehicleCapacity <= 0 ||
+       deliveries.size() > (long long)numVehicles * vehicleCapacity)
+        return OVER_CAPACITY;
     
-    // go from point to point and generate the routes
-    for(int i = 0; i < betterDeliveries.size(); i++){
-        
-        // temporary variables to store each route and travel distance given by PointToPointerRouter
-        list<StreetSegment> route;
-        double travelDist = 0;
-        // generate a route from the current location to the next coordinate
-        GeoCoord nextCoord = betterDeliveries[i].location;
-        DeliveryResult result = m_router.generatePointToPointRoute(curCoord, betterDeliveries[i].location, route, travelDist);
-        
+    int numDepots = depots.size(), numStops = numDepots + deliveries.size();
+    vector<GeoCoord> stops(depots);
+    for(int i = 0; i < deliveries.size(); i++)
+        stops.push_back(deliveries[i].location);
+    int component;
+    for(int i = 0; i < numStops; i++)
+        if(!m_sm->getComponentOf(stops[i], component))
+            return BAD_COORD;
+    
+    ThreadPool& pool = ThreadPool::shared();
+    vector<vector<double>> dist(numStops);
+    {
+        TaskGroup rows(pool);
+        for(int i = 0; i < numStops; i++)
+            rows.run([this, i, &stops, &dist]() {
+                m_router.generateDistancesFrom(stops[i], stops, dist[i]);
+                for(int j = 0; j < dist[i].size(); j++)
+                    if(dist[i][j] < 0)
+                        dist[i][j] = UNREACHABLE;
+            });
+    }
+    
+    // each delivery starts out with the depot it has the shortest round trip with
+    vector<int> depotOf(deliveries.size());
+    for(int i = 0; i < deliveries.size(); i++){
+        int stop = numDepots + i;
+        double best = UNREACHABLE;
+        depotOf[i] = -1;
+        for(int d = 0; d < numDepots; d++){
+            double roundTrip = dist[d][stop] + dist[stop][d];
+            if(roundTrip < best){
+                best = roundTrip;
+                depotOf[i] = d;
+            }
+        }
+        if(depotOf[i] < 0)   // no depot can reach this delivery
+            return NO_ROUTE;
+    }
+    
+    FleetRoutes fleet(dist, numDepots, vehicleCapacity);
+    fleet.build(depotOf);
+    if(!fleet.reduceTo(numVehicles))
+        return NO_ROUTE;
+    fleet.improve();
+    
+    plans.resize(fleet.numRoutes());
+    vector<DeliveryResult> results(fleet.numRoutes(), DELIVERY_SUCCESS);
+    {
+        TaskGroup vehicles(pool);
+        for(int r = 0; r < fleet.numRoutes(); r++)
+            vehicles.run([this, r, &fleet, &dist, &depots, &deliveries, &plans, &results]() {
+                const vector<int>& route = fleet.stopsOf(r);
+                int depot = fleet.depotOf(r);
+                
+                // the optimizer wants the depot as stop 0 and the deliveries after it
+                vector<int> index(1, depot);
+                index.insert(index.end(), route.begin(), route.end());
+                vector<vector<double>> roadDistances(index.size(), vector<double>(index.size()));
+                for(int i = 0; i < index.size(); i++)
+                    for(int j = 0; j < index.size(); j++)
+                        roadDistances[i][j] = dist[index[i]][index[j]];
+                
+                VehiclePlan& plan = plans[r];
+                plan.depot = depot;
+                for(int i = 0; i < route.size(); i++)
+                    plan.deliveries.push_back(deliveries[route[i] - depots.size()]);
+                double ocd, ncd;
+                m_optimizer.optimizeDeliveryOrder(depots[depot], plan.deliveries, roadDistances, ocd, ncd);
+                
+                results[r] = planInOrder(depots[depot], plan.deliveries, plan.commands, plan.distanceTravelled);
+            });
+    }
+    
+    for(int r = 0; r < plans.size(); r++){
+        if(results[r] != DELIVERY_SUCCESS)
+            return results[r];
+        totalDistanceTravelled += plans[r].distanceTravelled;
+    }
+    return DELIVERY_SUCCESS;
+}
+
+// Routes depot -> each delivery in the order given -> depot and turns every leg into commands.
+// Once the order is fixed the legs don't depend on each other, so they are all routed at once
+// on the shared pool (the router keeps its search state per thread) and stitched together in
+// order afterwards, which gives exactly the commands routing them one by one would.  The
+// routes themselves go to legRoutes if the caller wants them, and the size commands had once
+// each leg's commands, its delivery included, were appended to legCommandEnds.
+DeliveryResult DeliveryPlannerImpl::planInOrder(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& orderedDeliveries,
+    vector<DeliveryCommand>& commands,
+    double& totalDistanceTravelled,
+    vector<StreetRoute>* legRoutes,
+    vector<size_t>* legCommandEnds) const
+{
+    // the extra last leg goes back to the depot
+    int numLegs = orderedDeliveries.size() + 1;
+    vector<StreetRoute> routes(numLegs);
+    vector<double> travelDists(numLegs, 0);
+    vector<DeliveryResult> results(numLegs);
+    {
+        TaskGroup legs(ThreadPool::shared());
+        for(int i = 0; i < numLegs; i++)
+            legs.run([this, i, numLegs, &depot, &orderedDeliveries, &routes, &travelDists, &results]() {
+                TRACE_SPAN(span, "route leg");
+                TRACE_COUNT(span, "leg", i);
+                const GeoCoord& from = i == 0 ? depot : orderedDeliveries[i - 1].location;
+                const GeoCoord& to = i == numLegs - 1 ? depot : orderedDeliveries[i].location;
+                results[i] = m_router.generatePointToPointRoute(from, to, routes[i], travelDists[i]);
+            });
+    }
+    if(legRoutes)
+        legRoutes->swap(routes);
+    const vector<StreetRoute>& legs = legRoutes ? *legRoutes : routes;
+    
+    TRACE_SPAN(span, "commands");
+    TRACE_COUNT(span, "legs", numLegs);
+    totalDistanceTravelled = 0;
+    for(int i = 0; i < numLegs; i++){
         // add to the total distance travelled
-        totalDistanceTravelled += travelDist;
+        totalDistanceTravelled += travelDists[i];
         
         // make sure the path was routed successfully
-        if(result != DELIVERY_SUCCESS)
-            return result;
-    
-        curSeg = route.begin();
+        if(results[i] != DELIVERY_SUCCESS)
+            return results[i];
         
-        // first generate a proceed command to the start of the route
-        DeliveryCommand proceed;
-        proceed.initAsProceedCommand(generateProceedCommand(*curSeg), curSeg->name, distanceEarthMiles(curSeg->start, curSeg->end));
-        commands.push_back(proceed);
-        prevSeg = curSeg;
-        curSeg++;
+        appendLegCommands(legs[i], commands);
         
-        // iterate through the route and generate turns and proceed commands
-        while(curSeg != route.end()){
-            double curSegDistance = distanceEarthMiles(curSeg->start, curSeg->end);
-            // proceed onto same street
-            if(curSeg->name == prevSeg->name){
-                commands[commands.size()-1].increaseDistance(curSegDistance);
-            }
-            else{
-                int decision = generateTurnCommand(*prevSeg, *curSeg);
-                if(decision == 1){ // left turn command
-                    DeliveryCommand leftTurn;
-                    leftTurn.initAsTurnCommand("left", curSeg->name);
-                    commands.push_back(leftTurn);
-                }
-                else{ // right turn command
-                    DeliveryCommand rightTurn;
-                    rightTurn.initAsTurnCommand("right", curSeg->name);
-                    commands.push_back(rightTurn);
-                }
-                // always has a proceed command following the turn even when no turn
-                DeliveryCommand curProceed;
-                curProceed.initAsProceedCommand(generateProceedCommand(*curSeg), curSeg->name, curSegDistance);
-                commands.push_back(curProceed);
-            }
-            // move to next segment of route
-            prevSeg = curSeg;
-            curSeg++;
-        }
-        
-        if(betterDeliveries[i].item == "DEPOT")  // when the last DeliveryRequest is back to the depot, the loop returns success
+        if(i == numLegs - 1){  // back at the depot, so every delivery has been made
+            if(legCommandEnds)
+                legCommandEnds->push_back(commands.size());
             return DELIVERY_SUCCESS;
+        }
         
         // generate deliver command when done
         DeliveryCommand delivered;
-        delivered.initAsDeliverCommand(betterDeliveries[i].item);
+        delivered.initAsDeliverCommand(orderedDeliveries[i].item);
         commands.push_back(delivered);
-        
-        // update current location
-        curCoord = nextCoord;
+        if(legCommandEnds)
+            legCommandEnds->push_back(commands.size());
     }
     return DELIVERY_SUCCESS;
 }
 
-string DeliveryPlannerImpl::generateProceedCommand(StreetSegment seg) const
+// Appends the proceed and turn commands for one leg.  A leg between two stops at the same
+// coordinate has no segments and so no commands.  Street names go into the commands as their
+// ids, straight from the map's edges, so no names are copied.
+void DeliveryPlannerImpl::appendLegCommands(const StreetRoute& route, vector<DeliveryCommand>& commands) const
+{
+    if(route.empty())
+        return;
+    
+    // only the geometry is needed for the angles, so these segments carry no names
+    int curEdge = route.edgeId(0), prevEdge;
+    StreetSegment curSeg(m_sm->edgeStart(curEdge), m_sm->edgeEnd(curEdge), ""), prevSeg;
+    
+    // first generate a proceed command to the start of the route
+    DeliveryCommand proceed;
+    proceed.initAsProceedCommand(generateProceedCommand(curSeg), m_sm->edgeNameId(curEdge), m_sm->edgeLength(curEdge));
+    commands.push_back(proceed);
+    
+    // iterate through the route and generate turns and proceed commands
+    for(int i = 1; i < route.size(); i++){
+        prevEdge = curEdge;
+        prevSeg = curSeg;
+        curEdge = route.edgeId(i);
+        curSeg = StreetSegment(m_sm->edgeStart(curEdge), m_sm->edgeEnd(curEdge), "");
+        double curSegDistance = m_sm->edgeLength(curEdge);
+        // proceed onto same street
+        if(m_sm->edgeNameId(curEdge) == m_sm->edgeNameId(prevEdge)){
+            commands[commands.size()-1].increaseDistance(curSegDistance);
+        }
+        else{
+            int decision = generateTurnCommand(prevSeg, curSeg);
+            DeliveryCommand turn;
+            if(decision == 1) // left turn command
+                turn.initAsTurnCommand(DeliveryCommand::LEFT, m_sm->edgeNameId(curEdge));
+            else // right turn command
+                turn.initAsTurnCommand(DeliveryCommand::RIGHT, m_sm->edgeNameId(curEdge));
+            commands.push_back(turn);
+            // always has a proceed command following the turn even when no turn
+            DeliveryCommand curProceed;
+            curProceed.initAsProceedCommand(generateProceedCommand(curSeg), m_sm->edgeNameId(curEdge), curSegDistance);
+            commands.push_back(curProceed);
+        }
+    }
+}
+
+DeliveryResult DeliveryPlannerImpl::validateDeliveries(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries) const
+{
+    int depotComponent;
+    if(!m_sm->getComponentOf(depot, depotComponent))
+        return BAD_COORD;
+    
+    // bad coordinates take priority over unreachable ones, same as they do for a single route
+    bool allConnected = true;
+    for(int i = 0; i < deliveries.size(); i++){
+        int component;
+        if(!m_sm->getComponentOf(deliveries[i].location, component))
+            return BAD_COORD;
+        if(component != depotComponent)
+            allConnected = false;
+    }
+    return allConnected ? DELIVERY_SUCCESS : NO_ROUTE;
+}
+
+DeliveryCommand::Direction DeliveryPlannerImpl::generateProceedCommand(const StreetSegment& seg) const
 {
     double angle = angleOfLine(seg);
     if(angle < 22.5)
-        return "east";
+        return DeliveryCommand::EAST;
     if(angle < 67.5)
-        return "northeast";
+        return DeliveryCommand::NORTHEAST;
     if(angle < 112.5)
-        return "north";
+        return DeliveryCommand::NORTH;
     if(angle < 157.5)
-        return "northwest";
+        return DeliveryCommand::NORTHWEST;
     if(angle < 202.5)
-        return "west";
+        return DeliveryCommand::WEST;
     if(angle < 247.5)
-        return "southwest";
+        return DeliveryCommand::SOUTHWEST;
     if(angle < 292.5)
-        return "south";
+        return DeliveryCommand::SOUTH;
     if(angle < 337.5)
-        return "southeast";
+        return DeliveryCommand::SOUTHEAST;
     else
-        return "east";
+        return DeliveryCommand::EAST;
 }
 
-int DeliveryPlannerImpl::generateTurnCommand(StreetSegment seg1, StreetSegment seg2) const
+int DeliveryPlannerImpl::generateTurnCommand(const StreetSegment& seg1, const StreetSegment& seg2) const
 {
     double angle = angleBetween2Lines(seg1, seg2);
     if(angle < 1 || angle > 359)
@@ -157,6 +602,202 @@ int DeliveryPlannerImpl::generateTurnCommand(StreetSegment seg1, StreetSegment s
         return 2; // right command
 }
 
+class IncrementalPlannerImpl
+{
+public:
+    IncrementalPlannerImpl(const StreetMap* sm);
+    ~IncrementalPlannerImpl();
+    DeliveryResult startPlan(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        vector<DeliveryCommand>& commands,
+        double& totalDistanceTravelled);
+    DeliveryResult addDelivery(
+        const DeliveryRequest& delivery,
+        DeliveryCommandDiff& diff,
+        double& totalDistanceTravelled);
+    void markDelivered(int numDelivered);
+    const vector<DeliveryRequest>& deliveries() const;
+    void getCommands(vector<DeliveryCommand>& commands) const;
+    double totalDistanceTravelled() const;
+    
+private:
+    // Leg i runs from stop i-1 (the depot for i == 0) to stop i (the depot for the last leg)
+    // and its commands end with the delivery at stop i.
+    struct Leg
+    {
+        StreetRoute route;
+        vector<DeliveryCommand> commands;
+    };
+    
+    DeliveryPlannerImpl     m_planner;
+    GeoCoord                m_depot;
+    vector<DeliveryRequest> m_stops;
+    vector<Leg>             m_legs;
+    double                  m_distance;
+    int                     m_delivered;
+    
+    const GeoCoord& stopLocation(int stop) const;
+    DeliveryResult routeLeg(const GeoCoord& from, const GeoCoord& to, const DeliveryRequest* delivery, Leg& leg) const;
+};
+
+IncrementalPlannerImpl::IncrementalPlannerImpl(const StreetMap* sm)
+: m_planner(sm), m_distance(0), m_delivered(0)
+{
+}
+
+IncrementalPlannerImpl::~IncrementalPlannerImpl()
+{
+}
+
+DeliveryResult IncrementalPlannerImpl::startPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    vector<DeliveryCommand>& commands,
+    double& totalDistanceTravelled)
+{
+    m_depot = depot;
+    m_stops.clear();
+    m_legs.clear();
+    m_distance = 0;
+    m_delivered = 0;
+    totalDistanceTravelled = 0;
+    
+    int depotComponent;
+    if(!m_planner.m_sm->getComponentOf(depot, depotComponent))
+        return BAD_COORD;
+    if(!deliveries.empty()){
+        DeliveryResult batchResult = m_planner.validateDeliveries(depot, deliveries);
+        if(batchResult != DELIVERY_SUCCESS)
+            return batchResult;
+    }
+    
+    vector<DeliveryRequest> ordered(deliveries);
+    double ocd, ncd;
+    m_planner.m_optimizer.optimizeDeliveryOrder(depot, ordered, ocd, ncd);
+    
+    // routed and turned into commands exactly as a one-off plan is, then cut up by leg
+    vector<DeliveryCommand> planned;
+    vector<StreetRoute> routes;
+    vector<size_t> commandEnds;
+    double distance;
+    DeliveryResult result = m_planner.planInOrder(depot, ordered, planned, distance, &routes, &commandEnds);
+    if(result != DELIVERY_SUCCESS)
+        return result;
+    vector<Leg> legs(routes.size());
+    for(int i = 0; i < legs.size(); i++){
+        legs[i].route = routes[i];
+        legs[i].commands.assign(planned.begin() + (i == 0 ? 0 : commandEnds[i - 1]), planned.begin() + commandEnds[i]);
+    }
+    
+    m_stops.swap(ordered);
+    m_legs.swap(legs);
+    m_distance = distance;
+    getCommands(commands);
+    totalDistanceTravelled = m_distance;
+    return DELIVERY_SUCCESS;
+}
+
+// Splits the leg where the delivery adds the least crow distance into two freshly routed legs.
+// Finding the leg is a pass of haversine calls; the routing, which dominates, only ever covers
+// the two new legs however many stops are planned.
+DeliveryResult IncrementalPlannerImpl::addDelivery(
+    const DeliveryRequest& delivery,
+    DeliveryCommandDiff& diff,
+    double& totalDistanceTravelled)
+{
+    totalDistanceTravelled = m_distance;
+    if(m_legs.empty())   // no plan started
+        return NO_ROUTE;
+    vector<DeliveryRequest> single(1, delivery);
+    DeliveryResult result = m_planner.validateDeliveries(m_depot, single);
+    if(result != DELIVERY_SUCCESS)
+        return result;
+    
+    int bestLeg = m_delivered;
+    double bestAdded = 0;
+    for(int i = m_delivered; i < m_legs.size(); i++){
+        const GeoCoord& from = stopLocation(i - 1);
+        const GeoCoord& to = stopLocation(i);
+        double added = distanceEarthMiles(from, delivery.location) + distanceEarthMiles(delivery.location, to) - distanceEarthMiles(from, to);
+        if(i == m_delivered || added < bestAdded){
+            bestAdded = added;
+            bestLeg = i;
+        }
+    }
+    
+    Leg toNew, fromNew;
+    bool returningToDepot = bestLeg == m_stops.size();
+    result = routeLeg(stopLocation(bestLeg - 1), delivery.location, &delivery, toNew);
+    if(result == DELIVERY_SUCCESS)
+        result = routeLeg(delivery.location, stopLocation(bestLeg), returningToDepot ? nullptr : &m_stops[bestLeg], fromNew);
+    if(result != DELIVERY_SUCCESS)
+        return result;
+    
+    diff.first = 0;
+    for(int i = 0; i < bestLeg; i++)
+        diff.first += m_legs[i].commands.size();
+    diff.removed = m_legs[bestLeg].commands.size();
+    diff.inserted = toNew.commands;
+    diff.inserted.insert(diff.inserted.end(), fromNew.commands.begin(), fromNew.commands.end());
+    
+    m_distance += toNew.route.distance() + fromNew.route.distance() - m_legs[bestLeg].route.distance();
+    m_stops.insert(m_stops.begin() + bestLeg, delivery);
+    m_legs[bestLeg] = fromNew;
+    m_legs.insert(m_legs.begin() + bestLeg, toNew);
+    totalDistanceTravelled = m_distance;
+    return DELIVERY_SUCCESS;
+}
+
+void IncrementalPlannerImpl::markDelivered(int numDelivered)
+{
+    m_delivered = max(0, min(numDelivered, (int)m_stops.size()));
+}
+
+const vector<DeliveryRequest>& IncrementalPlannerImpl::deliveries() const
+{
+    return m_stops;
+}
+
+void IncrementalPlannerImpl::getCommands(vector<DeliveryCommand>& commands) const
+{
+    commands.clear();
+    for(int i = 0; i < m_legs.size(); i++)
+        commands.insert(commands.end(), m_legs[i].commands.begin(), m_legs[i].commands.end());
+}
+
+double IncrementalPlannerImpl::totalDistanceTravelled() const
+{
+    return m_distance;
+}
+
+// -1 and the stop past the last one are both the depot
+const GeoCoord& IncrementalPlannerImpl::stopLocation(int stop) const
+{
+    if(stop < 0 || stop >= m_stops.size())
+        return m_depot;
+    return m_stops[stop].location;
+}
+
+// Routes one leg and generates its commands, ending with the delivery if there is one, for the
+// legs an insertion creates; the initial plan comes from planInOrder.
+DeliveryResult IncrementalPlannerImpl::routeLeg(const GeoCoord& from, const GeoCoord& to, const DeliveryRequest* delivery, Leg& leg) const
+{
+    double travelDist;
+    DeliveryResult result = m_planner.m_router.generatePointToPointRoute(from, to, leg.route, travelDist);
+    if(result != DELIVERY_SUCCESS)
+        return result;
+    
+    leg.commands.clear();
+    m_planner.appendLegCommands(leg.route, leg.commands);
+    if(delivery){
+        DeliveryCommand delivered;
+        delivered.initAsDeliverCommand(delivery->item);
+        leg.commands.push_back(delivered);
+    }
+    return DELIVERY_SUCCESS;
+}
+
 //******************** DeliveryPlanner functions ******************************
 
 // These functions simply delegate to DeliveryPlannerImpl's functions.
@@ -178,5 +819,82 @@ DeliveryResult DeliveryPlanner::generateDeliveryPlan(
     vector<DeliveryCommand>& commands,
     double& totalDistanceTravelled) const
 {
-    return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled);
+    return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled, nullptr);
+}
+
+DeliveryResult DeliveryPlanner::generateDeliveryPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    vector<DeliveryCommand>& commands,
+    double& totalDistanceTravelled,
+    vector<StreetRoute>& legRoutes) const
+{
+    return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled, &legRoutes);
+}
+
+DeliveryResult DeliveryPlanner::generateFleetPlan(
+    const vector<GeoCoord>& depots,
+    const vector<DeliveryRequest>& deliveries,
+    int numVehicles,
+    int vehicleCapacity,
+    vector<VehiclePlan>& plans,
+    double& totalDistanceTravelled) const
+{
+    return m_impl->generateFleetPlan(depots, deliveries, numVehicles, vehicleCapacity, plans, totalDistanceTravelled);
+}
+
+void DeliveryPlanner::setTurnPenalties(double left, double right, double uTurn)
+{
+    m_impl->setTurnPenalties(left, right, uTurn);
+}
+
+//******************** IncrementalPlanner functions ***************************
+
+// These functions simply delegate to IncrementalPlannerImpl's functions.
+
+IncrementalPlanner::IncrementalPlanner(const StreetMap* sm)
+{
+    m_impl = new IncrementalPlannerImpl(sm);
+}
+
+IncrementalPlanner::~IncrementalPlanner()
+{
+    delete m_impl;
+}
+
+DeliveryResult IncrementalPlanner::startPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    vector<DeliveryCommand>& commands,
+    double& totalDistanceTravelled)
+{
+    return m_impl->startPlan(depot, deliveries, commands, totalDistanceTravelled);
+}
+
+DeliveryResult IncrementalPlanner::addDelivery(
+    const DeliveryRequest& delivery,
+    DeliveryCommandDiff& diff,
+    double& totalDistanceTravelled)
+{
+    return m_impl->addDelivery(delivery, diff, totalDistanceTravelled);
+}
+
+void IncrementalPlanner::markDelivered(int numDelivered)
+{
+    m_impl->markDelivered(numDelivered);
+}
+
+const vector<DeliveryRequest>& IncrementalPlanner::deliveries() const
+{
+    return m_impl->deliveries();
+}
+
+void IncrementalPlanner::getCommands(vector<DeliveryCommand>& commands) const
+{
+    m_impl->getCommands(commands);
+}
+
+double IncrementalPlanner::totalDistanceTravelled() const
+{
+    return m_impl->totalDistanceTravelled();
 }
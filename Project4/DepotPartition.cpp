@@ -0,0 +1,142 @@
+#include "DepotPartition.h"
+#include <algorithm>
+#include <functional>
+#include "Trace.h"
+using namespace std;
+
+DepotPartition::DepotPartition(const StreetMap* sm)
+ : m_sm(sm), m_owner(sm->nodeCount(), -1), m_miles(sm->nodeCount(), -1)
+{
+}
+
+bool DepotPartition::setDepots(const vector<GeoCoord>& depots)
+{
+    TRACE_SPAN(span, "DepotPartition::setDepots");
+    TRACE_COUNT(span, "depots", depots.size());
+    vector<int> nodes(depots.size());
+    for(int i = 0; i < depots.size(); i++)
+        if(!m_sm->getNodeId(depots[i], nodes[i]))
+            return false;
+
+    m_depotNode = nodes;
+    fill(m_owner.begin(), m_owner.end(), -1);
+    fill(m_miles.begin(), m_miles.end(), -1);
+    m_open.clear();
+    for(int i = 0; i < nodes.size(); i++)
+        offer(Label{0, i, nodes[i]});
+    settle();
+    return true;
+}
+
+// Only nodes the new depot is nearer to than their current one can change, and those are
+// connected to it through each other, so a search from it that stops wherever it doesn't win
+// visits exactly them.
+int DepotPartition::addDepot(const GeoCoord& depot)
+{
+    TRACE_SPAN(span, "DepotPartition::addDepot");
+    int node;
+    if(!m_sm->getNodeId(depot, node))
+        return -1;
+    int id = m_depotNode.size();
+    m_depotNode.push_back(node);
+    m_open.clear();
+    offer(Label{0, id, node});
+    settle();
+    return id;
+}
+
+// The depot's nodes are unlabeled, then each is offered the best label a neighbor held by some
+// other depot can pass on, and the search carries on from there.  Every segment is in the map
+// both ways with the same length, so an edge out of a node also says how far it is coming in.
+bool DepotPartition::removeDepot(int depotId)
+{
+    TRACE_SPAN(span, "DepotPartition::removeDepot");
+    if(!hasDepot(depotId))
+        return false;
+    m_depotNode[depotId] = -1;
+    vector<int> orphans;
+    for(int node = 0; node < m_owner.size(); node++){
+        if(m_owner[node] == depotId){
+            m_owner[node] = -1;
+            m_miles[node] = -1;
+            orphans.push_back(node);
+        }
+    }
+
+    m_open.clear();
+    for(int i = 0; i < orphans.size(); i++){
+        const vector<int>& edges = m_sm->edgesFrom(orphans[i]);
+        for(int k = 0; k < edges.size(); k++){
+            int neighbor = m_sm->edgeTo(edges[k]);
+            if(m_owner[neighbor] >= 0)
+                offer(Label{m_miles[neighbor] + m_sm->edgeLength(edges[k]), m_owner[neighbor], orphans[i]});
+        }
+    }
+    settle();
+    TRACE_COUNT(span, "nodes", orphans.size());
+    return true;
+}
+
+bool DepotPartition::nearestDepot(const GeoCoord& gc, int& depotId, double& miles) const
+{
+    int node;
+    if(!m_sm->getNodeId(gc, node) || m_owner[node] < 0)
+        return false;
+    depotId = m_owner[node];
+    miles = m_miles[node];
+    return true;
+}
+
+int DepotPartition::nodeDepot(int nodeId) const
+{
+    return m_owner[nodeId];
+}
+
+double DepotPartition::nodeDistance(int nodeId) const
+{
+    return m_miles[nodeId];
+}
+
+int DepotPartition::depotIdCount() const
+{
+    return m_depotNode.size();
+}
+
+bool DepotPartition::hasDepot(int depotId) const
+{
+    return depotId >= 0 && depotId < m_depotNode.size() && m_depotNode[depotId] >= 0;
+}
+
+// whether label beats the one its node has now
+bool DepotPartition::improves(const Label& label) const
+{
+    int node = label.node;
+    return m_owner[node] < 0 || Label{m_miles[node], m_owner[node], node} > label;
+}
+
+void DepotPartition::offer(const Label& label)
+{
+    if(!improves(label))
+        return;
+    m_owner[label.node] = label.depot;
+    m_miles[label.node] = label.miles;
+    m_open.push_back(label);
+    push_heap(m_open.begin(), m_open.end(), greater<Label>());
+}
+
+// Dijkstra from whatever has been offered.  An entry is stale once its node has a better label,
+// which is the only way a node's label changes after its entry was pushed.
+void DepotPartition::settle()
+{
+    greater<Label> later;
+    while(!m_open.empty()){
+        pop_heap(m_open.begin(), m_open.end(), later);
+        Label label = m_open.back();
+        m_open.pop_back();
+        if(m_owner[label.node] != label.depot || m_miles[label.node] != label.miles)
+            continue;
+        const vector<int>& edges = m_sm->edgesFrom(label.node);
+        for(int i = 0; i < edges.size(); i++)
+            offer(Label{label.miles + m_sm->edgeLength(edges[i]), label.depot, m_sm->edgeTo(edges[i])});
+    }
+}
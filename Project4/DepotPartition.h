@@ -0,0 +1,69 @@
+// DepotPartition.h
+
+// Which depot is nearest to every node of a map, by road distance driven out from the depot,
+// so assigning an order is a node lookup instead of a search per depot.  The labels come from
+// one Dijkstra seeded at every depot at once; ties go to the lower depot id, so the result
+// doesn't depend on the order depots were added in.
+//
+// Adding a depot only searches the nodes it takes over.  Removing one only searches the nodes
+// it held, starting from the labels of their neighbors.  Both give exactly the labels a search
+// from scratch would.  Depot ids stay the same for as long as the depot is in the partition.
+//
+// Lookups don't modify anything, so any number of threads can make them while no depot is
+// being added or removed.
+
+#ifndef DEPOTPARTITION_INCLUDED
+#define DEPOTPARTITION_INCLUDED
+
+#include "provided.h"
+#include <vector>
+
+class DepotPartition
+{
+public:
+    DepotPartition(const StreetMap* sm);
+      // Replaces every depot and labels the map from scratch.  False, changing nothing, if a
+      // depot isn't on the map; otherwise depots[i] gets id i.
+    bool setDepots(const std::vector<GeoCoord>& depots);
+      // the new depot's id, or -1 if it isn't on the map
+    int addDepot(const GeoCoord& depot);
+    bool removeDepot(int depotId);
+      // The depot nearest gc and how far it is.  False if gc isn't on the map or no depot can
+      // reach it.
+    bool nearestDepot(const GeoCoord& gc, int& depotId, double& miles) const;
+      // per node, -1 and a negative distance where no depot reaches
+    int nodeDepot(int nodeId) const;
+    double nodeDistance(int nodeId) const;
+      // ids ever handed out, removed ones included
+    int depotIdCount() const;
+    bool hasDepot(int depotId) const;
+    DepotPartition(const DepotPartition&) = delete;
+    DepotPartition& operator=(const DepotPartition&) = delete;
+private:
+      // a tentative label for a node, ordered by distance and then depot id
+    struct Label
+    {
+        double miles;
+        int depot;
+        int node;
+
+        bool operator>(const Label& other) const
+        {
+            if (miles != other.miles)
+                return miles > other.miles;
+            return depot > other.depot;
+        }
+    };
+
+    const StreetMap* m_sm;
+    std::vector<int> m_depotNode;     // depot id -> node, -1 once removed
+    std::vector<int> m_owner;         // node -> depot id, -1 if unreached
+    std::vector<double> m_miles;      // node -> distance from its depot
+    std::vector<Label> m_open;        // binary heap, nearest label on top
+
+    bool improves(const Label& label) const;
+    void offer(const Label& label);
+    void settle();
+};
+
+#endif // DEPOTPARTITION_INCLUDED
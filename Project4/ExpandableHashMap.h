@@ -4,6 +4,7 @@
 // member functions.
 #include <list>
 #include <vector>
+#include <cstddef>
 
 template<typename KeyType, typename ValueType>
 class ExpandableHashMap
@@ -13,6 +14,8 @@ public:
     ~ExpandableHashMap();
     void reset();
     int size() const;
+      // bytes held by the buckets and entries, not counting anything keys or values allocate
+    size_t bytesUsed() const;
     void associate(const KeyType& key, const ValueType& value);
 
       // for a map that can't be modified, return a pointer to const ValueType
@@ -63,16 +66,21 @@ ExpandableHashMap<KeyType, ValueType>::ExpandableHashMap(double maximumLoadFacto
 template<typename KeyType, typename ValueType>
 ExpandableHashMap<KeyType, ValueType>::~ExpandableHashMap()
 {
-    m_map.clear();
-    m_numAssociations = 0;
+    reset();
 }
 
+// deletes every node, then goes back to 8 empty buckets as if newly constructed
 template<typename KeyType, typename ValueType>
 void ExpandableHashMap<KeyType, ValueType>::reset()
 {
-    m_map.clear();
+    for(int bucket = 0; bucket < m_map.size(); bucket++){
+        typename std::list<Node*>::iterator it;
+        for(it = m_map[bucket].begin(); it != m_map[bucket].end(); it++)
+            delete *it;
+    }
     m_numAssociations = 0;
     m_numBuckets = 8;
+    std::vector<std::list<Node*>>(m_numBuckets).swap(m_map);   // clear() would keep the big bucket array
 }
 
 template<typename KeyType, typename ValueType>
@@ -81,6 +89,14 @@ int ExpandableHashMap<KeyType, ValueType>::size() const
     return m_numAssociations;
 }
 
+// each entry is a Node from new plus the list node pointing at it: two links and the pointer
+template<typename KeyType, typename ValueType>
+size_t ExpandableHashMap<KeyType, ValueType>::bytesUsed() const
+{
+    return m_map.capacity() * sizeof(std::list<Node*>)
+        + size_t(m_numAssociations) * (sizeof(Node) + 2 * sizeof(void*) + sizeof(Node*));
+}
+
 template<typename KeyType, typename ValueType>
 void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
 {
@@ -95,8 +111,7 @@ void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const
                 tempMap[newBuckNum].push_back(*it);
             }
         }
-        m_map.clear();
-        m_map = tempMap;
+        m_map.swap(tempMap);   // the nodes were moved, so the old buckets just go
     }
     unsigned int buckNum = getBucketNumber(key);
     // insert into or update map
@@ -120,11 +135,11 @@ void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const
 template<typename KeyType, typename ValueType>
 const ValueType* ExpandableHashMap<KeyType, ValueType>::find(const KeyType& key) const
 {
-    std::list<Node*> list;
-    typename std::list<Node*>::iterator it;
+    // walk the bucket in place; find only reads, so any number of threads can search a map
+    // that nobody is modifying
     unsigned int buckNum = getBucketNumber(key);
-    list = m_map[buckNum];
-    it = list.begin();
+    const std::list<Node*>& list = m_map[buckNum];
+    typename std::list<Node*>::const_iterator it = list.begin();
     for(; it != list.end(); it++){
         Node* thisNode = *it;
         if(thisNode->k == key){
@@ -0,0 +1,58 @@
+// MapGenerator.cpp
+
+// Writes a synthetic city map, and optionally a deliveries file for it (see SyntheticCity.h).
+// Build it instead of main.cpp:
+//
+//     MapGenerator segments map.txt [deliveries.txt [stops [clusters [seed]]]]
+//
+// segments is approximate; the number actually written is printed.  clusters 0 spreads the
+// stops over the whole city.
+
+#include "SyntheticCity.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        cout << "Usage: " << argv[0] << " segments map.txt [deliveries.txt [stops [clusters [seed]]]]" << endl;
+        return 1;
+    }
+    CityOptions city;
+    city.segments = atol(argv[1]);
+    if (argc > 6)
+        city.seed = strtoul(argv[6], nullptr, 10);
+
+    ofstream mapOut(argv[2]);
+    long written = writeSyntheticCity(mapOut, city);
+    mapOut.close();
+    if (!mapOut)
+    {
+        cout << "Unable to write " << argv[2] << endl;
+        return 1;
+    }
+    cout << written << " segments (" << 2 * written << " edges) written to " << argv[2] << endl;
+
+    if (argc > 3)
+    {
+        WorkloadOptions workload;
+        if (argc > 4)
+            workload.stops = atoi(argv[4]);
+        if (argc > 5)
+            workload.clusters = atoi(argv[5]);
+        ofstream deliveriesOut(argv[3]);
+        writeSyntheticDeliveries(deliveriesOut, city, workload);
+        deliveriesOut.close();
+        if (!deliveriesOut)
+        {
+            cout << "Unable to write " << argv[3] << endl;
+            return 1;
+        }
+        cout << workload.stops << " deliveries written to " << argv[3] << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+// MemoryAccounting.h
+
+// Byte counting behind StreetMap::memoryReport.  Containers are counted by capacity, since
+// that is what they keep allocated.  Allocator overhead isn't counted at all, so the figures
+// are a floor under what RSS shows for the same structures.
+
+#ifndef MEMORYACCOUNTING_INCLUDED
+#define MEMORYACCOUNTING_INCLUDED
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+  // what s has allocated outside itself, which is nothing while it fits in the string's own
+  // small-string buffer
+inline size_t stringHeapBytes(const std::string& s)
+{
+    const char* data = s.data();
+    const char* self = reinterpret_cast<const char*>(&s);
+    if (data >= self && data < self + sizeof(s))
+        return 0;
+    return s.capacity() + 1;
+}
+
+template<typename T>
+inline size_t vectorBytes(const std::vector<T>& v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+  // the command string table: chunks, index and the strings' own allocations (DeliveryCommand.cpp)
+size_t commandStringBytes();
+
+  // what every thread's router search workspace holds right now (PointToPointRouter.cpp)
+size_t searchScratchBytes();
+
+#endif // MEMORYACCOUNTING_INCLUDED
@@ -0,0 +1,392 @@
+// PlanServer.cpp
+
+// Long-running planning server.  It loads the map once and answers planning requests until it
+// is stopped.  Build it instead of main.cpp:
+//
+//     PlanServer mapdata.txt --socket /path/to/socket     many clients over a Unix socket
+//     PlanServer mapdata.txt --stdin                      one client on stdin/stdout
+//
+// A request is a deliveries file exactly as main.cpp reads it (depot line, then one
+// "lat lon:item" line per delivery) followed by an empty line.  The response is the plan as
+// main.cpp prints it, after any complaints about lines that didn't parse, and is also ended by
+// an empty line.  Clients may send more requests without waiting for the answers; each
+// client's responses always come back in the order its requests were sent.
+//
+// One thread runs a poll() loop that does all the socket I/O and hands complete requests to
+// the shared worker pool.  A client stops being read while it has MAX_PIPELINED requests
+// unanswered or MAX_BUFFERED_OUTPUT bytes of responses it hasn't read, and no client is read
+// while MAX_IN_FLIGHT requests are being planned, so a fast sender can't make the server
+// queue unbounded work or memory.
+
+#include "provided.h"
+#include "DeliveryIO.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+using namespace std;
+
+static const int    MAX_PIPELINED = 16;                  // unanswered requests per client
+static const size_t MAX_BUFFERED_OUTPUT = 4 << 20;       // unread response bytes per client
+static const size_t MAX_REQUEST_BYTES = 16 << 20;        // longest request a client may send
+static const size_t READ_CHUNK = 64 << 10;
+
+  // a response being planned; the worker fills in text, then sets done
+struct PendingResponse
+{
+    PendingResponse()
+     : done(false)
+    {}
+
+    string       text;
+    atomic<bool> done;
+};
+
+struct Connection
+{
+    Connection(int in, int out)
+     : inFd(in), outFd(out), outputSent(0), inputClosed(false), broken(false)
+    {}
+
+    int    inFd;
+    int    outFd;                                // the same as inFd for a socket
+    string input;                                // bytes read that aren't a whole request yet
+    string output;                               // finished responses not yet written
+    size_t outputSent;                           // how much of output has been written
+    deque<shared_ptr<PendingResponse>> pending;  // in request order
+    bool   inputClosed;
+    bool   broken;                               // write failed or request too long
+
+    bool finished() const
+    {
+        return broken || (inputClosed && input.empty() && pending.empty() && outputSent == output.size());
+    }
+};
+
+class PlanServer
+{
+public:
+    PlanServer(const StreetMap* sm, int listenFd);
+    ~PlanServer();
+    void addConnection(int inFd, int outFd);
+    void run();   // returns once there is no listening socket and every connection is done
+
+private:
+    DeliveryPlanner   m_planner;
+    int               m_listenFd;   // -1 in stdin mode
+    int               m_wakeRead;   // workers write a byte here when a response is ready
+    int               m_wakeWrite;
+    atomic<int>       m_inFlight;
+    int               m_maxInFlight;
+    TaskGroup         m_plans;      // every plan() submitted, so the destructor can wait for them
+    vector<shared_ptr<Connection>> m_connections;
+
+    void acceptClients();
+    void readInput(Connection& c);
+    void dispatchRequests(Connection& c);
+    void collectResponses(Connection& c);
+    void writeOutput(Connection& c);
+    bool wantsInput(const Connection& c) const;
+    void plan(string request, shared_ptr<PendingResponse> response);
+};
+
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+PlanServer::PlanServer(const StreetMap* sm, int listenFd)
+ : m_planner(sm), m_listenFd(listenFd), m_inFlight(0), m_plans(ThreadPool::shared())
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        perror("pipe");
+        exit(1);
+    }
+    m_wakeRead = fds[0];
+    m_wakeWrite = fds[1];
+    setNonBlocking(m_wakeRead);
+    setNonBlocking(m_wakeWrite);
+    m_maxInFlight = 4 * ThreadPool::shared().size();
+}
+
+PlanServer::~PlanServer()
+{
+    // workers still planning for clients that went away use the planner and the wake pipe
+    m_plans.wait();
+    close(m_wakeRead);
+    close(m_wakeWrite);
+}
+
+void PlanServer::addConnection(int inFd, int outFd)
+{
+    setNonBlocking(inFd);
+    setNonBlocking(outFd);
+    m_connections.push_back(make_shared<Connection>(inFd, outFd));
+}
+
+bool PlanServer::wantsInput(const Connection& c) const
+{
+    return !c.inputClosed && c.pending.size() < MAX_PIPELINED &&
+           c.output.size() - c.outputSent < MAX_BUFFERED_OUTPUT &&
+           m_inFlight < m_maxInFlight;
+}
+
+void PlanServer::run()
+{
+    vector<pollfd> fds;
+    vector<int> inSlot, outSlot;   // per connection, its entry in fds or -1
+    while (m_listenFd >= 0 || !m_connections.empty())
+    {
+        fds.clear();
+        fds.push_back(pollfd{ m_wakeRead, POLLIN, 0 });
+        if (m_listenFd >= 0)
+            fds.push_back(pollfd{ m_listenFd, POLLIN, 0 });
+        inSlot.assign(m_connections.size(), -1);
+        outSlot.assign(m_connections.size(), -1);
+        for (size_t i = 0; i < m_connections.size(); i++)
+        {
+            Connection& c = *m_connections[i];
+            if (wantsInput(c))
+            {
+                inSlot[i] = fds.size();
+                fds.push_back(pollfd{ c.inFd, POLLIN, 0 });
+            }
+            if (c.outputSent < c.output.size())
+            {
+                if (c.outFd == c.inFd && inSlot[i] >= 0)
+                    fds[inSlot[i]].events |= POLLOUT;
+                else
+                    fds.push_back(pollfd{ c.outFd, POLLOUT, 0 });
+                outSlot[i] = c.outFd == c.inFd && inSlot[i] >= 0 ? inSlot[i] : fds.size() - 1;
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return;
+        }
+
+        if (fds[0].revents)
+        {
+            char drain[256];
+            while (read(m_wakeRead, drain, sizeof(drain)) > 0)
+                ;
+        }
+        if (m_listenFd >= 0 && fds[1].revents)
+            acceptClients();
+
+        for (size_t i = 0; i < inSlot.size(); i++)
+        {
+            Connection& c = *m_connections[i];
+            if (inSlot[i] >= 0 && (fds[inSlot[i]].revents & (POLLIN | POLLHUP | POLLERR)))
+                readInput(c);
+            if (outSlot[i] >= 0 && (fds[outSlot[i]].revents & (POLLOUT | POLLERR)))
+                writeOutput(c);
+        }
+
+        // every connection, not just the ones poll woke up: responses finish and limits
+        // free up without any I/O on the connection itself
+        for (size_t i = 0; i < m_connections.size(); i++)
+        {
+            Connection& c = *m_connections[i];
+            collectResponses(c);
+            dispatchRequests(c);
+            if (c.outputSent < c.output.size())
+                writeOutput(c);
+        }
+
+        vector<shared_ptr<Connection>> open;
+        for (size_t i = 0; i < m_connections.size(); i++)
+        {
+            Connection& c = *m_connections[i];
+            if (!c.finished())
+            {
+                open.push_back(m_connections[i]);
+                continue;
+            }
+            close(c.inFd);
+            if (c.outFd != c.inFd)
+                close(c.outFd);
+        }
+        m_connections.swap(open);
+    }
+}
+
+void PlanServer::acceptClients()
+{
+    for (;;)
+    {
+        int fd = accept(m_listenFd, nullptr, nullptr);
+        if (fd < 0)
+            return;
+        addConnection(fd, fd);
+    }
+}
+
+void PlanServer::readInput(Connection& c)
+{
+    char buffer[READ_CHUNK];
+    ssize_t n = read(c.inFd, buffer, sizeof(buffer));
+    if (n > 0)
+    {
+        c.input.append(buffer, n);
+        if (c.input.size() > MAX_REQUEST_BYTES && c.input.find("\n\n") == string::npos)
+            c.broken = true;
+    }
+    else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        c.inputClosed = true;
+}
+
+// Hands complete requests to the workers while the limits allow.  Once the client has stopped
+// sending, whatever is left counts as a last request even without its empty line.
+void PlanServer::dispatchRequests(Connection& c)
+{
+    while (c.pending.size() < MAX_PIPELINED && m_inFlight < m_maxInFlight && !c.broken)
+    {
+        string request;
+        size_t end = c.input.find("\n\n");
+        if (end != string::npos)
+        {
+            request = c.input.substr(0, end + 1);
+            c.input.erase(0, end + 2);
+        }
+        else if (c.inputClosed && !c.input.empty())
+        {
+            request.swap(c.input);
+        }
+        else
+            return;
+
+        if (request.find_first_not_of(" \t\r\n") == string::npos)   // stray blank lines
+            continue;
+        shared_ptr<PendingResponse> response = make_shared<PendingResponse>();
+        c.pending.push_back(response);
+        m_inFlight++;
+        m_plans.run([this, request, response]() { plan(request, response); });
+    }
+}
+
+void PlanServer::collectResponses(Connection& c)
+{
+    while (!c.pending.empty() && c.pending.front()->done.load(memory_order_acquire))
+    {
+        if (c.outputSent == c.output.size())
+        {
+            c.output.clear();
+            c.outputSent = 0;
+        }
+        c.output += c.pending.front()->text;
+        c.pending.pop_front();
+    }
+}
+
+void PlanServer::writeOutput(Connection& c)
+{
+    while (c.outputSent < c.output.size())
+    {
+        ssize_t n = write(c.outFd, c.output.data() + c.outputSent, c.output.size() - c.outputSent);
+        if (n > 0)
+            c.outputSent += n;
+        else
+        {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                c.broken = true;
+            return;
+        }
+    }
+}
+
+// runs on a worker thread
+void PlanServer::plan(string request, shared_ptr<PendingResponse> response)
+{
+    istringstream in(request);
+    ostringstream out;
+    GeoCoord depot;
+    vector<DeliveryRequest> deliveries;
+    // coordinates that aren't numbers get this request a BAD_COORD answer, nothing more
+    bool valid = readDeliveryRequests(in, depot, deliveries, out);
+    vector<DeliveryCommand> commands;
+    double totalMiles = 0;
+    DeliveryResult result = valid ? m_planner.generateDeliveryPlan(depot, deliveries, commands, totalMiles) : BAD_COORD;
+    response->text = out.str();
+    formatDeliveryPlan(response->text, result, commands, totalMiles);
+    response->text += '\n';
+
+    m_inFlight--;
+    response->done.store(true, memory_order_release);
+    char wake = 0;
+    // a failed write means the pipe is full, so the loop is already due to wake up
+    (void)!write(m_wakeWrite, &wake, 1);
+}
+
+static int listenOn(const string& path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        cout << "Socket path too long: " << path << endl;
+        return -1;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (fd < 0 || ::bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0)
+    {
+        perror(path.c_str());
+        return -1;
+    }
+    setNonBlocking(fd);
+    return fd;
+}
+
+int main(int argc, char* argv[])
+{
+    bool socketMode = argc == 4 && string(argv[2]) == "--socket";
+    bool stdinMode = argc == 3 && string(argv[2]) == "--stdin";
+    if (!socketMode && !stdinMode)
+    {
+        cout << "Usage: " << argv[0] << " mapdata.txt --socket path" << endl;
+        cout << "       " << argv[0] << " mapdata.txt --stdin" << endl;
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);   // a client hanging up shows up as a failed write instead
+
+    StreetMap sm;
+    if (!sm.load(argv[1]))
+    {
+        cerr << "Unable to load map data file " << argv[1] << endl;
+        return 1;
+    }
+
+    int listenFd = -1;
+    if (socketMode)
+    {
+        listenFd = listenOn(argv[3]);
+        if (listenFd < 0)
+            return 1;
+        cerr << "Listening on " << argv[3] << endl;
+    }
+    PlanServer server(&sm, listenFd);
+    if (stdinMode)
+        server.addConnection(STDIN_FILENO, STDOUT_FILENO);
+    server.run();
+}
@@ -1,12 +1,128 @@
 #include "provided.h"
 #include <list>
-#include <set>
-#include <stack>
+#include <vector>
 #include <utility>
-#include <tuple>
-#include "ExpandableHashMap.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include "RouterStats.h"
+#include "Trace.h"
+#include "MemoryAccounting.h"
+#include "ThreadPool.h"
+#include <atomic>
 using namespace std;
 
+// bytes held by every thread's workspaces, kept up to date by SearchWorkspace::account()
+static atomic<size_t> s_scratchBytes(0);
+
+// Search state for one thread, sized to the map and reused by every query that thread runs, so
+// once the arrays have grown a query allocates nothing.  An entry only counts if its stamp is
+// the current query's, which saves clearing the arrays between queries.
+struct SearchWorkspace
+{
+    SearchWorkspace()
+     : stamp(0), accountedBytes(0)
+    {}
+    
+    ~SearchWorkspace()
+    {
+        s_scratchBytes -= accountedBytes;
+    }
+    
+    vector<unsigned> reached;           // stamp of the query that last gave the node a g
+    vector<unsigned> closed;            // stamp of the query that last settled the node
+    vector<unsigned> marked;            // stamp of the query that last marked the node a target
+    vector<double> g;
+    vector<double> h;
+    vector<int> parentEdge;             // edge the node was reached by, -1 for the start
+    vector<int> firstTarget;            // for marked nodes, the first target index there
+    vector<pair<double, int>> open;     // binary heap of (f, node)
+    unsigned stamp;
+    size_t accountedBytes;              // this workspace's share of s_scratchBytes
+    
+    void begin(int numNodes)
+    {
+        if(reached.size() < numNodes){
+            reached.resize(numNodes, 0);
+            closed.resize(numNodes, 0);
+            marked.resize(numNodes, 0);
+            g.resize(numNodes);
+            h.resize(numNodes);
+            parentEdge.resize(numNodes);
+            firstTarget.resize(numNodes);
+        }
+        if(++stamp == 0){   // wrapped around, so old stamps could look current again
+            fill(reached.begin(), reached.end(), 0);
+            fill(closed.begin(), closed.end(), 0);
+            fill(marked.begin(), marked.end(), 0);
+            stamp = 1;
+        }
+        open.clear();
+    }
+    
+    size_t bytes() const
+    {
+        return vectorBytes(reached) + vectorBytes(closed) + vectorBytes(marked) + vectorBytes(g) + vectorBytes(h)
+            + vectorBytes(parentEdge) + vectorBytes(firstTarget) + vectorBytes(open);
+    }
+    
+    // Brings s_scratchBytes up to date with what this workspace holds.  Called after each query
+    // rather than as the arrays grow, so searching never touches the shared counter.
+    size_t account()
+    {
+        size_t now = bytes();
+        if(now != accountedBytes){
+            s_scratchBytes += now - accountedBytes;
+            accountedBytes = now;
+        }
+        return now;
+    }
+    
+    void reach(int node, int edge, double nodeG, double nodeH)
+    {
+        reached[node] = stamp;
+        parentEdge[node] = edge;
+        g[node] = nodeG;
+        h[node] = nodeH;
+    }
+};
+
+static SearchWorkspace& threadWorkspace()
+{
+    static thread_local SearchWorkspace workspace;
+    return workspace;
+}
+
+// Turn-aware searches index their state by edge rather than node, so they get their own
+// workspace instead of regrowing the node one back and forth.
+static SearchWorkspace& threadEdgeWorkspace()
+{
+    static thread_local SearchWorkspace workspace;
+    return workspace;
+}
+
+// Heap order for the open list: lowest f first, ties broken by coordinate so routes come out
+// exactly as they did when the open list was a set<pair<double, GeoCoord>>.
+class OpenListOrder
+{
+public:
+    OpenListOrder(const StreetMap* sm)
+     : m_sm(sm)
+    {}
+    
+    bool operator()(const pair<double, int>& a, const pair<double, int>& b) const
+    {
+        if(a.first != b.first)
+            return a.first > b.first;
+        return m_sm->nodeCoord(b.second) < m_sm->nodeCoord(a.second);
+    }
+    
+private:
+    const StreetMap* m_sm;
+};
+
+// Queries never modify the router or the map, and all search state lives in the calling
+// thread's workspace, so one router can answer queries from many threads at once.
 class PointToPointRouterImpl
 {
 public:
@@ -15,34 +131,41 @@ public:
     DeliveryResult generatePointToPointRoute(
         const GeoCoord& start,
         const GeoCoord& end,
-        list<StreetSegment>& route,
-        double& totalDistanceTravelled) const;
+        StreetRoute& route,
+        double& totalDistanceTravelled,
+        RouteQueryStats* stats) const;
+    DeliveryResult generateDistancesFrom(
+        const GeoCoord& start,
+        const vector<GeoCoord>& targets,
+        vector<double>& distances) const;
+    DeliveryResult generateServiceArea(
+        const GeoCoord& start,
+        double maxMiles,
+        ServiceArea& area) const;
+    DeliveryResult generateServiceAreas(
+        const vector<GeoCoord>& depots,
+        double maxMiles,
+        vector<ServiceArea>& areas) const;
+    void exportStats(ostream& out) const;
+    void setTurnPenalties(double left, double right, double uTurn);
     
 private:
     const StreetMap* m_sm;
+    mutable RouterStatsAggregate m_aggregate;
+    bool m_turnAware;
+    double m_turnPenalty[4];    // miles added per StreetMap::TurnClass
     
-    struct coordDeets{
-        coordDeets(){
-            
-        }
-        
-        coordDeets(GeoCoord parent, double g, double h){
-            m_parent = parent;
-            m_g = g;
-            m_h = h;
-        }
-        
-        GeoCoord m_parent;
-        double m_g;
-        double m_h;
-    };
-    
-    void tracePath(GeoCoord start, GeoCoord end, ExpandableHashMap<GeoCoord, coordDeets>* coordDetailsPtr, list<StreetSegment>& route, double& totalDistanceTravelled) const;
+    DeliveryResult findRoute(const GeoCoord& start, const GeoCoord& end, StreetRoute& route, double& totalDistanceTravelled, RouteQueryStats* stats) const;
+    DeliveryResult findTurnAwareRoute(int startNode, int endNode, const GeoCoord& end, StreetRoute& route, double& totalDistanceTravelled, RouteQueryStats* stats) const;
+    void tracePath(int startNode, int endNode, const SearchWorkspace& ws, StreetRoute& route, double& totalDistanceTravelled) const;
+    size_t accountScratch() const;
 };
 
 PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm)
 {
     m_sm = sm;
+    m_turnAware = false;
+    fill(m_turnPenalty, m_turnPenalty + 4, 0.0);
 }
 
 PointToPointRouterImpl::~PointToPointRouterImpl()
@@ -52,57 +175,124 @@ PointToPointRouterImpl::~PointToPointRouterImpl()
 DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
         const GeoCoord& start,
         const GeoCoord& end,
-        list<StreetSegment>& route,
-        double& totalDistanceTravelled) const
+        StreetRoute& route,
+        double& totalDistanceTravelled,
+        RouteQueryStats* stats) const
+{
+    route.clear();
+    route.m_sm = m_sm;
+#ifdef ROUTER_STATS
+    RouteQueryStats localStats;
+    RouteQueryStats& queryStats = stats ? *stats : localStats;
+    queryStats.clear();
+    DeliveryResult result = findRoute(start, end, route, totalDistanceTravelled, &queryStats);
+    queryStats.scratchBytes = accountScratch();
+    m_aggregate.record(queryStats);
+    return result;
+#else
+    DeliveryResult result = findRoute(start, end, route, totalDistanceTravelled, stats);
+    accountScratch();
+    return result;
+#endif
+}
+
+// the workspace the last query on this thread used; returns its size
+size_t PointToPointRouterImpl::accountScratch() const
+{
+    return (m_turnAware ? threadEdgeWorkspace() : threadWorkspace()).account();
+}
+
+void PointToPointRouterImpl::exportStats(ostream& out) const
 {
+    m_aggregate.exportStats(out);
+}
+
+void PointToPointRouterImpl::setTurnPenalties(double left, double right, double uTurn)
+{
+    // a negative cost would make the straight-line heuristic overestimate, and A* could then
+    // settle a state before its cheapest way in was found
+    left = max(0.0, left);
+    right = max(0.0, right);
+    uTurn = max(0.0, uTurn);
+    m_turnPenalty[StreetMap::TURN_STRAIGHT] = 0;
+    m_turnPenalty[StreetMap::TURN_LEFT] = left;
+    m_turnPenalty[StreetMap::TURN_RIGHT] = right;
+    m_turnPenalty[StreetMap::TURN_U] = uTurn;
+    m_turnAware = left > 0 || right > 0 || uTurn > 0;
+}
+
+DeliveryResult PointToPointRouterImpl::findRoute(const GeoCoord& start, const GeoCoord& end, StreetRoute& route, double& totalDistanceTravelled, RouteQueryStats* stats) const
+{
+    TRACE_SPAN(span, "route");
+    ROUTER_STAT(chrono::steady_clock::time_point searchStart = chrono::steady_clock::now());
+    
     if(start == end){   // 0 length path because the user is already at the destination
-        route.clear();
         totalDistanceTravelled = 0;
         return DELIVERY_SUCCESS;
     }
     
-    vector<StreetSegment> nextSegs;
-    if(!(m_sm->getSegmentsThatStartWith(end, nextSegs) && m_sm->getSegmentsThatStartWith(start, nextSegs))){   // either start or end is not in the loaded map data
+    int startNode, endNode;
+    ROUTER_STAT(stats->hashLookups += 2);
+    if(!(m_sm->getNodeId(end, endNode) && m_sm->getNodeId(start, startNode))){   // either start or end is not in the loaded map data
         //cerr << "Bad Coordinates!" << endl;
         return BAD_COORD;
     }
     
+    // start and end lie in disconnected parts of the map, so searching would only exhaust start's component
+    if(m_sm->nodeComponent(startNode) != m_sm->nodeComponent(endNode))
+        return NO_ROUTE;
+    
+    if(m_turnAware){
+        DeliveryResult result = findTurnAwareRoute(startNode, endNode, end, route, totalDistanceTravelled, stats);
+        TRACE_COUNT(span, "edges", route.size());
+        ROUTER_STAT(stats->searchSeconds = secondsSince(searchStart));
+        return result;
+    }
+    
     // run A* algorithm if the start and end are valid routing points
     
-    set<pair<double, GeoCoord>> openList;
-    ExpandableHashMap<GeoCoord, bool> closedList;
-    ExpandableHashMap<GeoCoord, coordDeets> coordDetails;
+    SearchWorkspace& ws = threadWorkspace();
+    ws.begin(m_sm->nodeCount());
+    OpenListOrder later(m_sm);
     
     // add starting node to open list
-    openList.insert(pair<double, GeoCoord>(0, start));
-    coordDetails.associate(start, coordDeets(start, 0, distanceEarthMiles(start, end)));
-    
-    // set this flag to false since destination not reached
-    bool foundDest = false;
+    ws.reach(startNode, -1, 0, distanceEarthMiles(start, end));
+    ws.open.push_back(pair<double, int>(0, startNode));
+    ROUTER_STAT(stats->heapPushes++; stats->peakOpenListSize = 1);
     
-    while(!openList.empty())
+    while(!ws.open.empty())
     {
-        pair<double, GeoCoord> p = *openList.begin();
+        pop_heap(ws.open.begin(), ws.open.end(), later);
+        pair<double, int> p = ws.open.back();
+        ws.open.pop_back();
+        ROUTER_STAT(stats->heapPops++);
         
-        openList.erase(openList.begin());
-        closedList.associate(p.second, true);
-        vector<StreetSegment> successors;
-        m_sm->getSegmentsThatStartWith(p.second, successors);
+        // a stale entry left behind by a later improvement; the node was expanded already
+        if(ws.closed[p.second] == ws.stamp){
+            ROUTER_STAT(stats->stalePops++);
+            continue;
+        }
+        ROUTER_STAT(stats->nodesSettled++);
+        ws.closed[p.second] = ws.stamp;
+        if(m_sm->isFrontier(p.second))
+            route.m_frontier.push_back(p.second);
         
-        // iterate through all adjacent GeoCoords of the current GeoCoord
+        // iterate through all edges leaving the current node
+        const vector<int>& successors = m_sm->edgesFrom(p.second);
         for(int i = 0; i < successors.size(); i++){
-            // get current GeoCoord
-            GeoCoord curNode = successors[i].end;
+            // get the node this edge leads to
+            int curNode = m_sm->edgeTo(successors[i]);
             
-            // if the current GeoCoord is the destination
-            if(curNode == end){
-                foundDest = true;
-                coordDeets endDeets(p.second, 0, 0);
-                coordDetails.associate(curNode, endDeets);
+            // if the current node is the destination
+            if(curNode == endNode){
+                ws.parentEdge[endNode] = successors[i];
                 
-                // call a path tracing function that changes the route list and totalDistanceTravelled value by retracing the path
-                ExpandableHashMap<GeoCoord, coordDeets>* coordDetailsPtr = &coordDetails;
-                tracePath(start, end, coordDetailsPtr, route, totalDistanceTravelled);
+                // call a path tracing function that fills the route and totalDistanceTravelled by retracing the path
+                ROUTER_STAT(stats->searchSeconds = secondsSince(searchStart));
+                ROUTER_STAT(chrono::steady_clock::time_point traceStart = chrono::steady_clock::now());
+                tracePath(startNode, endNode, ws, route, totalDistanceTravelled);
+                ROUTER_STAT(stats->traceSeconds = secondsSince(traceStart));
+                TRACE_COUNT(span, "edges", route.size());
                 
                 //cerr << "Path completed successfully!" << endl;
                 return DELIVERY_SUCCESS;
@@ -110,58 +300,269 @@ DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
             
             // if successor is already on closed list, ignore it
             // else, do the following
-            else if(!closedList.find(curNode)){
-                //double g = coordDetails.find(p.second)->m_g + 1;
-                double g = distanceEarthMiles(p.second, curNode) + coordDetails.find(p.second)->m_g;
-                double h = distanceEarthMiles(curNode, end);
+            else if(ws.closed[curNode] != ws.stamp){
+                ROUTER_STAT(stats->edgesRelaxed++);
+                double g = m_sm->edgeLength(successors[i]) + ws.g[p.second];
+                double h = distanceEarthMiles(m_sm->nodeCoord(curNode), end);
                 double f = g + h;
                 
-                coordDeets* curDetails = coordDetails.find(curNode);
-                // if the node isn't on the open list or the current path is better than calculated before, put the curNode on the open list, set its parent to the root it came from and update its g and h in coordDeetails
-                if(!curDetails || (curDetails->m_g + curDetails->m_h) > f){
-                    openList.insert(pair<double, GeoCoord>(f, curNode));
-                    coordDeets cd(p.second, g, h);
-                    coordDetails.associate(curNode, cd);
+                // if the node isn't on the open list or the current path is better than calculated before, put the curNode on the open list and record the edge it came from and its g and h
+                if(ws.reached[curNode] != ws.stamp || (ws.g[curNode] + ws.h[curNode]) > f){
+                    ws.reach(curNode, successors[i], g, h);
+                    ws.open.push_back(pair<double, int>(f, curNode));
+                    push_heap(ws.open.begin(), ws.open.end(), later);
+                    ROUTER_STAT(stats->heapPushes++);
+                    ROUTER_STAT(if(ws.open.size() > stats->peakOpenListSize) stats->peakOpenListSize = ws.open.size());
                 }
             }
         }
     }
     
     //cerr << "NO ROUTE!" << endl;
-    return NO_ROUTE;  // Delete this line and implement this function correctly
+    ROUTER_STAT(stats->searchSeconds = secondsSince(searchStart));
+    return NO_ROUTE;
 }
 
-void PointToPointRouterImpl::tracePath(GeoCoord start, GeoCoord end, ExpandableHashMap<GeoCoord, coordDeets>* coordDetailsPtr, list<StreetSegment>& route, double& totalDistanceTravelled) const{
+// A* over the edge-expanded graph without ever building it: a search state is the edge the
+// driver arrived on, so what a turn costs depends on both edges, and the successors of a state
+// are the edges leaving its end with their turn classes already worked out by the map.  State
+// arrays are one entry per edge, about twice the node search's.  A state only counts as reached
+// the destination once it is popped, since a turn penalty can make the first edge found into
+// endNode a worse way in than one found later.
+DeliveryResult PointToPointRouterImpl::findTurnAwareRoute(int startNode, int endNode, const GeoCoord& end, StreetRoute& route, double& totalDistanceTravelled, RouteQueryStats* stats) const
+{
+    (void)stats;   // only ROUTER_STAT reads it
+    SearchWorkspace& ws = threadEdgeWorkspace();
+    ws.begin(m_sm->edgeCount());
+    greater<pair<double, int>> later;
     
-    totalDistanceTravelled = 0;
-    GeoCoord parent = coordDetailsPtr->find(end)->m_parent;
-    stack<StreetSegment> backwardsPath;
-    
-    do{
-        vector<StreetSegment> segs;
-        m_sm->getSegmentsThatStartWith(parent, segs);
-        StreetSegment curSeg;
-        for(int i = 0; i < segs.size(); i++)
-        {
-            //cerr << curSeg.name << endl;
-            if(segs[i].end == end){
-                curSeg = segs[i];
-                break;
+    // no turn is made leaving the start, so every edge out of it begins at its own length
+    const vector<int>& firstEdges = m_sm->edgesFrom(startNode);
+    for(int i = 0; i < firstEdges.size(); i++){
+        int edge = firstEdges[i];
+        double g = m_sm->edgeLength(edge);
+        double h = distanceEarthMiles(m_sm->edgeEnd(edge), end);
+        ws.reach(edge, -1, g, h);
+        ws.open.push_back(pair<double, int>(g + h, edge));
+        push_heap(ws.open.begin(), ws.open.end(), later);
+        ROUTER_STAT(stats->heapPushes++);
+    }
+    
+    while(!ws.open.empty()){
+        pop_heap(ws.open.begin(), ws.open.end(), later);
+        int edge = ws.open.back().second;
+        ws.open.pop_back();
+        ROUTER_STAT(stats->heapPops++);
+        if(ws.closed[edge] == ws.stamp){
+            ROUTER_STAT(stats->stalePops++);
+            continue;
+        }
+        ROUTER_STAT(stats->nodesSettled++);
+        ws.closed[edge] = ws.stamp;
+        
+        int node = m_sm->edgeTo(edge);
+        if(m_sm->isFrontier(node))
+            route.m_frontier.push_back(node);
+        if(node == endNode){
+            ROUTER_STAT(chrono::steady_clock::time_point traceStart = chrono::steady_clock::now());
+            totalDistanceTravelled = 0;
+            for(int cur = edge; cur != -1; cur = ws.parentEdge[cur]){
+                route.m_edges.push_back(cur);
+                totalDistanceTravelled += m_sm->edgeLength(cur);
             }
+            reverse(route.m_edges.begin(), route.m_edges.end());
+            route.m_distance = totalDistanceTravelled;
+            ROUTER_STAT(stats->traceSeconds = secondsSince(traceStart));
+            return DELIVERY_SUCCESS;
         }
-        backwardsPath.push(curSeg);
-        totalDistanceTravelled += distanceEarthMiles(curSeg.start, curSeg.end);
-        end = parent;
-        parent = coordDetailsPtr->find(end)->m_parent;
-    }while(end != start);
+        
+        const vector<int>& successors = m_sm->edgesFrom(node);
+        for(int k = 0; k < successors.size(); k++){
+            int next = successors[k];
+            if(ws.closed[next] == ws.stamp)
+                continue;
+            ROUTER_STAT(stats->edgesRelaxed++);
+            double g = ws.g[edge] + m_sm->edgeLength(next) + m_turnPenalty[m_sm->turnClass(edge, k)];
+            if(ws.reached[next] != ws.stamp || ws.g[next] > g){
+                double h = ws.reached[next] == ws.stamp ? ws.h[next] : distanceEarthMiles(m_sm->edgeEnd(next), end);
+                ws.reach(next, edge, g, h);
+                ws.open.push_back(pair<double, int>(g + h, next));
+                push_heap(ws.open.begin(), ws.open.end(), later);
+                ROUTER_STAT(stats->heapPushes++);
+                ROUTER_STAT(if(ws.open.size() > stats->peakOpenListSize) stats->peakOpenListSize = ws.open.size());
+            }
+        }
+    }
+    return NO_ROUTE;
+}
+
+// Plain Dijkstra from start that stops as soon as every reachable target has been settled, so
+// one search answers a whole row of a distance matrix.
+DeliveryResult PointToPointRouterImpl::generateDistancesFrom(
+        const GeoCoord& start,
+        const vector<GeoCoord>& targets,
+        vector<double>& distances) const
+{
+    TRACE_SPAN(span, "generateDistancesFrom");
+    TRACE_COUNT(span, "targets", targets.size());
+    distances.assign(targets.size(), -1);
+    int startNode;
+    if(!m_sm->getNodeId(start, startNode))
+        return BAD_COORD;
+    
+    SearchWorkspace& ws = threadWorkspace();
+    ws.begin(m_sm->nodeCount());
+    
+    // mark every target node, chaining the indices of targets that share a node; targets in
+    // other components are left out since the search will never get to them
+    vector<int> nextTarget(targets.size(), -1);
+    int remaining = 0;
+    for(int i = 0; i < targets.size(); i++){
+        int node;
+        if(!m_sm->getNodeId(targets[i], node))
+            return BAD_COORD;
+        if(m_sm->nodeComponent(node) != m_sm->nodeComponent(startNode))
+            continue;
+        if(ws.marked[node] == ws.stamp)
+            nextTarget[i] = ws.firstTarget[node];
+        ws.marked[node] = ws.stamp;
+        ws.firstTarget[node] = i;
+        remaining++;
+    }
+    
+    ws.reach(startNode, -1, 0, 0);
+    ws.open.push_back(pair<double, int>(0, startNode));
+    greater<pair<double, int>> later;
+    while(remaining > 0 && !ws.open.empty()){
+        pop_heap(ws.open.begin(), ws.open.end(), later);
+        pair<double, int> p = ws.open.back();
+        ws.open.pop_back();
+        if(ws.closed[p.second] == ws.stamp)   // a stale entry left behind by a later improvement
+            continue;
+        ws.closed[p.second] = ws.stamp;
+        
+        if(ws.marked[p.second] == ws.stamp){
+            for(int i = ws.firstTarget[p.second]; i >= 0; i = nextTarget[i]){
+                distances[i] = p.first;
+                remaining--;
+            }
+        }
+        
+        const vector<int>& successors = m_sm->edgesFrom(p.second);
+        for(int i = 0; i < successors.size(); i++){
+            int next = m_sm->edgeTo(successors[i]);
+            if(ws.closed[next] == ws.stamp)
+                continue;
+            double g = p.first + m_sm->edgeLength(successors[i]);
+            if(ws.reached[next] != ws.stamp || ws.g[next] > g){
+                ws.reach(next, successors[i], g, 0);
+                ws.open.push_back(pair<double, int>(g, next));
+                push_heap(ws.open.begin(), ws.open.end(), later);
+            }
+        }
+    }
+    ws.account();
+    return DELIVERY_SUCCESS;
+}
+
+// Dijkstra from start that settles only nodes within maxMiles, so it touches the area and the
+// edges leaving it and nothing further out.  Each settled node's edges are sorted into the area
+// by where they end: inside the limit, or past it.
+DeliveryResult PointToPointRouterImpl::generateServiceArea(
+        const GeoCoord& start,
+        double maxMiles,
+        ServiceArea& area) const
+{
+    TRACE_SPAN(span, "generateServiceArea");
+    area.clear();
+    int startNode;
+    if(!m_sm->getNodeId(start, startNode))
+        return BAD_COORD;
+    
+    SearchWorkspace& ws = threadWorkspace();
+    ws.begin(m_sm->nodeCount());
+    ws.reach(startNode, -1, 0, 0);
+    ws.open.push_back(pair<double, int>(0, startNode));
+    greater<pair<double, int>> later;
+    while(!ws.open.empty()){
+        pop_heap(ws.open.begin(), ws.open.end(), later);
+        pair<double, int> p = ws.open.back();
+        ws.open.pop_back();
+        if(p.first > maxMiles)   // every node left is further out
+            break;
+        if(ws.closed[p.second] == ws.stamp)   // a stale entry left behind by a later improvement
+            continue;
+        ws.closed[p.second] = ws.stamp;
+        
+        const vector<int>& successors = m_sm->edgesFrom(p.second);
+        for(int i = 0; i < successors.size(); i++){
+            int edge = successors[i];
+            double g = p.first + m_sm->edgeLength(edge);
+            if(g > maxMiles){
+                area.boundaryEdges.push_back(edge);
+                area.boundaryMiles.push_back(maxMiles - p.first);
+                continue;
+            }
+            area.edges.push_back(edge);
+            int next = m_sm->edgeTo(edge);
+            if(ws.closed[next] != ws.stamp && (ws.reached[next] != ws.stamp || ws.g[next] > g)){
+                ws.reach(next, edge, g, 0);
+                ws.open.push_back(pair<double, int>(g, next));
+                push_heap(ws.open.begin(), ws.open.end(), later);
+            }
+        }
+    }
+    TRACE_COUNT(span, "edges", area.edges.size());
+    ws.account();
+    return DELIVERY_SUCCESS;
+}
+
+// Each depot's search runs in whichever pool thread picks it up, in that thread's workspace.
+DeliveryResult PointToPointRouterImpl::generateServiceAreas(
+        const vector<GeoCoord>& depots,
+        double maxMiles,
+        vector<ServiceArea>& areas) const
+{
+    TRACE_SPAN(span, "generateServiceAreas");
+    areas.clear();
+    int node;
+    for(int i = 0; i < depots.size(); i++)
+        if(!m_sm->getNodeId(depots[i], node))
+            return BAD_COORD;
+    
+    areas.resize(depots.size());
+    TaskGroup searches(ThreadPool::shared());
+    for(int i = 0; i < depots.size(); i++)
+        searches.run([this, i, maxMiles, &depots, &areas]() {
+            generateServiceArea(depots[i], maxMiles, areas[i]);
+        });
+    searches.wait();
+    return DELIVERY_SUCCESS;
+}
+
+// Follows the parent edges back from endNode, writing them straight into the route's buffer and
+// reversing it in place, so the only allocation is the buffer growing on first use.
+void PointToPointRouterImpl::tracePath(int startNode, int endNode, const SearchWorkspace& ws, StreetRoute& route, double& totalDistanceTravelled) const{
+    TRACE_SPAN(span, "tracePath");
     
-    //cerr << "Number of street segments: " << backwardsPath.size() << endl;
+    totalDistanceTravelled = 0;
+    int cur = endNode;
     
-    while(!backwardsPath.empty()){
-        //cerr << "Street: " << backwardsPath.top().name << endl;
-        route.push_back(backwardsPath.top());
-        backwardsPath.pop();
+    while(cur != startNode){
+        int edge = ws.parentEdge[cur];
+        route.m_edges.push_back(edge);
+        totalDistanceTravelled += m_sm->edgeLength(edge);
+        cur = m_sm->edgeFrom(edge);
     }
+    
+    //cerr << "Number of street segments: " << route.m_edges.size() << endl;
+    reverse(route.m_edges.begin(), route.m_edges.end());
+    route.m_distance = totalDistanceTravelled;
+}
+
+size_t searchScratchBytes()
+{
+    return s_scratchBytes;
 }
 
 //******************** PointToPointRouter functions ***************************
@@ -185,5 +586,64 @@ DeliveryResult PointToPointRouter::generatePointToPointRoute(
         list<StreetSegment>& route,
         double& totalDistanceTravelled) const
 {
-    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled);
+    return generatePointToPointRoute(start, end, route, totalDistanceTravelled, nullptr);
+}
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        RouteQueryStats* stats) const
+{
+    StreetRoute edgeRoute;
+    DeliveryResult result = m_impl->generatePointToPointRoute(start, end, edgeRoute, totalDistanceTravelled, stats);
+    route.clear();
+    if(result == DELIVERY_SUCCESS)
+        edgeRoute.appendSegments(route);
+    return result;
+}
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        StreetRoute& route,
+        double& totalDistanceTravelled,
+        RouteQueryStats* stats) const
+{
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled, stats);
+}
+
+DeliveryResult PointToPointRouter::generateDistancesFrom(
+        const GeoCoord& start,
+        const vector<GeoCoord>& targets,
+        vector<double>& distances) const
+{
+    return m_impl->generateDistancesFrom(start, targets, distances);
+}
+
+DeliveryResult PointToPointRouter::generateServiceArea(
+        const GeoCoord& start,
+        double maxMiles,
+        ServiceArea& area) const
+{
+    return m_impl->generateServiceArea(start, maxMiles, area);
+}
+
+DeliveryResult PointToPointRouter::generateServiceAreas(
+        const vector<GeoCoord>& depots,
+        double maxMiles,
+        vector<ServiceArea>& areas) const
+{
+    return m_impl->generateServiceAreas(depots, maxMiles, areas);
+}
+
+void PointToPointRouter::exportStats(ostream& out) const
+{
+    m_impl->exportStats(out);
+}
+
+void PointToPointRouter::setTurnPenalties(double left, double right, double uTurn)
+{
+    m_impl->setTurnPenalties(left, right, uTurn);
 }
@@ -0,0 +1,217 @@
+#include "RouteGeometry.h"
+#include <cmath>
+#include <cstdint>
+using namespace std;
+
+static double scaleFor(int precision)
+{
+    return pow(10.0, precision);
+}
+
+static int64_t zigzag(int64_t v)
+{
+    return (v << 1) ^ (v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// polyline characters: 5 bits each, 0x20 marks "more to come", 63 added to make it printable
+static void appendPolylineValue(int64_t delta, string& out)
+{
+    uint64_t v = zigzag(delta);
+    while (v >= 0x20)
+    {
+        out += char((0x20 | (v & 0x1f)) + 63);
+        v >>= 5;
+    }
+    out += char(v + 63);
+}
+
+void appendEncodedPolyline(const StreetRoute& route, string& out, int precision)
+{
+    if (route.empty())
+        return;
+    double scale = scaleFor(precision);
+    int64_t lastLat = 0, lastLon = 0;
+    for (int i = 0; i <= route.size(); i++)
+    {
+        const GeoCoord& p = route.point(i);
+        int64_t lat = llround(p.latitude * scale);
+        int64_t lon = llround(p.longitude * scale);
+        appendPolylineValue(lat - lastLat, out);
+        appendPolylineValue(lon - lastLon, out);
+        lastLat = lat;
+        lastLon = lon;
+    }
+}
+
+static bool readPolylineValue(const string& encoded, size_t& pos, int64_t& delta)
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 5)
+    {
+        if (pos >= encoded.size())
+            return false;
+        int c = encoded[pos++] - 63;
+        if (c < 0 || c > 63)
+            return false;
+        v |= uint64_t(c & 0x1f) << shift;
+        if (c < 0x20)
+        {
+            delta = unzigzag(v);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool decodePolyline(const string& encoded, vector<LatLon>& points, int precision)
+{
+    points.clear();
+    double scale = scaleFor(precision);
+    int64_t lat = 0, lon = 0;
+    size_t pos = 0;
+    while (pos < encoded.size())
+    {
+        int64_t dLat, dLon;
+        if (!readPolylineValue(encoded, pos, dLat) || !readPolylineValue(encoded, pos, dLon))
+            return false;
+        lat += dLat;
+        lon += dLon;
+        points.push_back(LatLon(lat / scale, lon / scale));
+    }
+    return true;
+}
+
+static void appendVarint(uint64_t v, string& out)
+{
+    while (v >= 0x80)
+    {
+        out += char(0x80 | (v & 0x7f));
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+static bool readVarint(istream& in, uint64_t& v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = in.get();
+        if (c == EOF)
+            return false;
+        v |= uint64_t(c & 0x7f) << shift;
+        if (c < 0x80)
+            return true;
+    }
+    return false;
+}
+
+bool writeRouteGeometry(ostream& out, const vector<StreetRoute>& legs, int precision)
+{
+    double scale = scaleFor(precision);
+    string header("GRG1");
+    appendVarint(precision, header);
+    appendVarint(legs.size(), header);
+    size_t numPoints = 0;
+    for (size_t i = 0; i < legs.size(); i++)
+    {
+        int points = legs[i].empty() ? 0 : legs[i].size() + 1;
+        appendVarint(points, header);
+        numPoints += points;
+    }
+
+    string latitudes, longitudes;
+    latitudes.reserve(numPoints * 2);
+    longitudes.reserve(numPoints * 2);
+    int64_t lastLat = 0, lastLon = 0;
+    for (size_t i = 0; i < legs.size(); i++)
+    {
+        if (legs[i].empty())
+            continue;
+        for (int k = 0; k <= legs[i].size(); k++)
+        {
+            const GeoCoord& p = legs[i].point(k);
+            int64_t lat = llround(p.latitude * scale);
+            int64_t lon = llround(p.longitude * scale);
+            appendVarint(zigzag(lat - lastLat), latitudes);
+            appendVarint(zigzag(lon - lastLon), longitudes);
+            lastLat = lat;
+            lastLon = lon;
+        }
+    }
+
+    out.write(header.data(), header.size());
+    out.write(latitudes.data(), latitudes.size());
+    out.write(longitudes.data(), longitudes.size());
+    return bool(out);
+}
+
+// bytes left in in, or -1 if it can't tell (a pipe, say)
+static long long bytesLeft(istream& in)
+{
+    streampos here = in.tellg();
+    if (here == streampos(-1))
+        return -1;
+    in.seekg(0, ios::end);
+    streampos end = in.tellg();
+    in.seekg(here);
+    return end == streampos(-1) ? -1 : (long long)(end - here);
+}
+
+// Every leg count takes at least a byte and every point at least two, one per column, so a header
+// claiming more than the rest of the file can hold is rejected before anything is allocated.
+// Where the size can't be known, the vectors grow only as bytes actually arrive.
+bool readRouteGeometry(istream& in, vector<vector<LatLon>>& legs)
+{
+    legs.clear();
+    char magic[4];
+    if (!in.read(magic, 4) || string(magic, 4) != "GRG1")
+        return false;
+    uint64_t precision, numLegs;
+    if (!readVarint(in, precision) || !readVarint(in, numLegs) || precision > 15)
+        return false;
+    double scale = scaleFor(precision);
+    long long available = bytesLeft(in);
+    if (available >= 0 && numLegs > uint64_t(available))
+        return false;
+
+    vector<uint64_t> counts;
+    uint64_t totalPoints = 0;
+    for (uint64_t i = 0; i < numLegs; i++)
+    {
+        uint64_t count;
+        if (!readVarint(in, count) || count > (1u << 28))   // no real leg is that long
+            return false;
+        counts.push_back(count);
+        totalPoints += count;
+        if (available >= 0 && totalPoints > uint64_t(available - numLegs) / 2)
+            return false;
+    }
+
+    // latitudes column, then longitudes column
+    legs.resize(numLegs);
+    for (int column = 0; column < 2; column++)
+    {
+        int64_t value = 0;
+        for (size_t i = 0; i < numLegs; i++)
+        {
+            for (size_t k = 0; k < counts[i]; k++)
+            {
+                uint64_t v;
+                if (!readVarint(in, v))
+                    return false;
+                value += unzigzag(v);
+                if (column == 0)
+                    legs[i].push_back(LatLon(value / scale, 0));
+                else
+                    legs[i][k].second = value / scale;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+// RouteGeometry.h
+
+// Compact exports of route geometry for clients that draw the route rather than read the
+// commands.  Both formats are built straight from a StreetRoute's edge ids.
+//
+// Encoded polyline: the widely used text format.  Each latitude and longitude is scaled by
+// 10^precision and rounded, stored as the difference from the previous point, zigzagged so
+// small negative numbers stay small, and written 5 bits per printable character.  Precision 5
+// (about a meter) is what most map libraries expect; 6 keeps everything the map file has.
+//
+// Binary columnar: "GRG1", then as varints the precision, the number of legs and each leg's
+// point count, then every latitude of every leg followed by every longitude, each as the
+// zigzag varint of its difference from the point before it (carrying across legs).  Keeping
+// the coordinates in two columns puts the similar deltas next to each other, which is what a
+// general-purpose compressor run over the file later likes best.
+
+#ifndef ROUTEGEOMETRY_INCLUDED
+#define ROUTEGEOMETRY_INCLUDED
+
+#include "provided.h"
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+  // a decoded point: latitude, longitude in degrees
+typedef std::pair<double, double> LatLon;
+
+void appendEncodedPolyline(const StreetRoute& route, std::string& out, int precision = 5);
+  // false if encoded is cut off or has characters a polyline can't contain
+bool decodePolyline(const std::string& encoded, std::vector<LatLon>& points, int precision = 5);
+
+bool writeRouteGeometry(std::ostream& out, const std::vector<StreetRoute>& legs, int precision = 6);
+bool readRouteGeometry(std::istream& in, std::vector<std::vector<LatLon>>& legs);
+
+#endif // ROUTEGEOMETRY_INCLUDED
@@ -0,0 +1,153 @@
+// RouterStats.h
+
+// Optional instrumentation for PointToPointRouter.  Build with -DROUTER_STATS to turn it on;
+// otherwise every ROUTER_STAT(...) in the search loop expands to nothing and the structs below
+// are simply never filled in.
+
+#ifndef ROUTERSTATS_INCLUDED
+#define ROUTERSTATS_INCLUDED
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+
+#ifdef ROUTER_STATS
+#define ROUTER_STAT(stmt) stmt
+#else
+#define ROUTER_STAT(stmt)
+#endif
+
+  // what a single generatePointToPointRoute call did
+struct RouteQueryStats
+{
+    RouteQueryStats()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        nodesSettled = 0;
+        edgesRelaxed = 0;
+        heapPushes = 0;
+        heapPops = 0;
+        stalePops = 0;
+        hashLookups = 0;
+        peakOpenListSize = 0;
+        scratchBytes = 0;
+        searchSeconds = 0;
+        traceSeconds = 0;
+    }
+
+    long   nodesSettled;      // nodes moved onto the closed list
+    long   edgesRelaxed;      // successors whose cost was recomputed
+    long   heapPushes;        // inserts into the open list
+    long   heapPops;          // removals from the open list, stale ones included
+    long   stalePops;         // pops of a node that had already been settled
+    long   hashLookups;       // finds/associates against the search maps and the StreetMap
+    long   peakOpenListSize;
+    long   scratchBytes;      // the thread's search workspace once done, which is its peak so far
+    double searchSeconds;     // wall time spent before tracePath
+    double traceSeconds;      // wall time spent in tracePath
+};
+
+  // running totals over every query a router has answered, plus a latency histogram; safe to
+  // record into from several threads at once
+class RouterStatsAggregate
+{
+public:
+    RouterStatsAggregate()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queries = 0;
+        m_totals.clear();
+        m_maxSeconds = 0;
+        for(int i = 0; i < NUM_BUCKETS; i++)
+            m_latencyBuckets[i] = 0;
+    }
+
+    void record(const RouteQueryStats& q)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queries++;
+        m_totals.nodesSettled += q.nodesSettled;
+        m_totals.edgesRelaxed += q.edgesRelaxed;
+        m_totals.heapPushes += q.heapPushes;
+        m_totals.heapPops += q.heapPops;
+        m_totals.stalePops += q.stalePops;
+        m_totals.hashLookups += q.hashLookups;
+        if(q.peakOpenListSize > m_totals.peakOpenListSize)
+            m_totals.peakOpenListSize = q.peakOpenListSize;
+        if(q.scratchBytes > m_totals.scratchBytes)
+            m_totals.scratchBytes = q.scratchBytes;
+        m_totals.searchSeconds += q.searchSeconds;
+        m_totals.traceSeconds += q.traceSeconds;
+        
+        double seconds = q.searchSeconds + q.traceSeconds;
+        if(seconds > m_maxSeconds)
+            m_maxSeconds = seconds;
+        m_latencyBuckets[bucketFor(seconds)]++;
+    }
+
+      // plain "name value" lines, one histogram line per non-empty bucket
+    void exportStats(std::ostream& out) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        out << "queries " << m_queries << "\n";
+        out << "nodes_settled " << m_totals.nodesSettled << "\n";
+        out << "edges_relaxed " << m_totals.edgesRelaxed << "\n";
+        out << "heap_pushes " << m_totals.heapPushes << "\n";
+        out << "heap_pops " << m_totals.heapPops << "\n";
+        out << "stale_pops " << m_totals.stalePops << "\n";
+        out << "hash_lookups " << m_totals.hashLookups << "\n";
+        out << "peak_open_list " << m_totals.peakOpenListSize << "\n";
+        out << "peak_scratch_bytes " << m_totals.scratchBytes << "\n";
+        out << "search_seconds " << m_totals.searchSeconds << "\n";
+        out << "trace_seconds " << m_totals.traceSeconds << "\n";
+        out << "max_query_seconds " << m_maxSeconds << "\n";
+        for(int i = 0; i < NUM_BUCKETS; i++){
+            if(m_latencyBuckets[i] != 0)
+                out << "latency_us_lt_" << (1L << i) << " " << m_latencyBuckets[i] << "\n";
+        }
+    }
+
+    long queries() const
+    {
+        return m_queries;
+    }
+
+    const RouteQueryStats& totals() const
+    {
+        return m_totals;
+    }
+
+private:
+    static const int NUM_BUCKETS = 32;   // powers of two in microseconds, so up to ~36 minutes
+
+    mutable std::mutex m_mutex;
+    long            m_queries;
+    RouteQueryStats m_totals;
+    double          m_maxSeconds;
+    long            m_latencyBuckets[NUM_BUCKETS];
+
+    static int bucketFor(double seconds)
+    {
+        double micros = seconds * 1e6;
+        int bucket = 0;
+        while(bucket < NUM_BUCKETS - 1 && micros >= (1L << bucket))
+            bucket++;
+        return bucket;
+    }
+};
+
+inline double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif // ROUTERSTATS_INCLUDED
@@ -3,8 +3,13 @@
 #include <vector>
 #include <functional>
 #include "ExpandableHashMap.h"
+#include "Trace.h"
+#include "MemoryAccounting.h"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
 using namespace std;
 
 unsigned int hasher(const GeoCoord& g)
@@ -17,20 +22,78 @@ unsigned int hasher(const string& g)
     return std::hash<string>()(g);
 }
 
+// Everything is built by load(); after that the const members only read, so once a map has
+// loaded any number of threads can query it at the same time.
 class StreetMapImpl
 {
 public:
     StreetMapImpl();
     ~StreetMapImpl();
     bool load(string mapFile);
+    bool load(istream& infile);
     bool getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const;
+    bool getComponentOf(const GeoCoord& gc, int& componentId) const;
+    int edgeCount() const;
+    bool getEdgesThatStartWith(const GeoCoord& gc, vector<int>& edgeIds) const;
+    bool getSegment(int edgeId, StreetSegment& seg) const;
+    const GeoCoord& edgeStart(int edgeId) const;
+    const GeoCoord& edgeEnd(int edgeId) const;
+    double edgeLength(int edgeId) const;
+    const string& edgeName(int edgeId) const;
+    int edgeNameId(int edgeId) const;
+    int nodeCount() const;
+    bool getNodeId(const GeoCoord& gc, int& nodeId) const;
+    const GeoCoord& nodeCoord(int nodeId) const;
+    int nodeComponent(int nodeId) const;
+    const vector<int>& edgesFrom(int nodeId) const;
+    int edgeFrom(int edgeId) const;
+    int edgeTo(int edgeId) const;
+    StreetMap::TurnClass turnClass(int fromEdge, int k) const;
+    bool findStreets(const string& prefix, vector<int>& nameIds) const;
+    bool getStreetEdges(int nameId, vector<int>& edgeIds) const;
+    bool findIntersections(const string& streets, vector<int>& nodeIds) const;
+    void reorderNodes(StreetMap::NodeOrder order);
+    StreetMap::NodeOrder nodeOrder() const;
+    MapMemoryReport memoryReport() const;
+    void markFrontier(const function<bool(const GeoCoord&)>& outside);
+    bool isFrontier(int nodeId) const;
     
 private:
-    ExpandableHashMap<GeoCoord, vector<StreetSegment>> m_map;
-    void insertSeg(StreetSegment seg);
+    // one directed edge per direction of every segment in the map file
+    struct Edge{
+        int from;       // node ids
+        int to;
+        int name;       // id in the command string table
+        double length;  // miles
+    };
+    
+    ExpandableHashMap<GeoCoord, int> m_nodeIds;
+    vector<GeoCoord> m_coords;           // node id -> coordinate, in the order each was first seen
+    vector<vector<int>> m_adjacency;     // node id -> ids of the edges leaving it
+    vector<int> m_components;            // node id -> component id
+    vector<Edge> m_edges;
+    vector<int> m_turnStart;             // edge id -> where its turns start in m_turns
+    vector<unsigned char> m_turns;       // TurnClass onto each edge leaving the edge's end
+    vector<unsigned char> m_frontier;    // node id -> 1 if on the frontier; empty for a whole map
+    vector<int> m_streetNames;           // street -> name id, streets sorted by name ignoring case
+    unordered_map<int, int> m_streetOf;  // name id -> street
+    vector<int> m_streetStart;           // street -> where its edges start in m_streetEdges
+    vector<int> m_streetEdges;
+    StreetMap::NodeOrder m_order;
+    vector<int> m_fileRank;              // node id -> id it had in file order; empty until reordered
+    
+    int nodeFor(const GeoCoord& gc);
+    void insertSeg(int from, int to, int name, double length);
+    void labelComponents();
+    void classifyTurns();
+    void indexStreetNames();
+    void hilbertOrder(vector<int>& nodes) const;
+    void bfsOrder(vector<int>& nodes) const;
+    int streetEdgeCount(const vector<int>& nameIds) const;
 };
 
 StreetMapImpl::StreetMapImpl()
+ : m_order(StreetMap::ORDER_FILE)
 {
 }
 
@@ -46,6 +109,28 @@ bool StreetMapImpl::load(string mapFile)
         //cerr << "Error: Cannot open the file" << endl;
         return false;
     }
+    return load(infile);
+}
+
+bool StreetMapImpl::load(istream& infile)
+{
+    TRACE_SPAN(span, "StreetMap::load");
+    
+    // loading again replaces the map rather than adding to it
+    m_nodeIds.reset();
+    m_coords.clear();
+    m_adjacency.clear();
+    m_components.clear();
+    m_edges.clear();
+    m_turnStart.clear();
+    m_turns.clear();
+    m_frontier.clear();
+    m_streetNames.clear();
+    m_streetOf.clear();
+    m_streetStart.clear();
+    m_streetEdges.clear();
+    m_fileRank.clear();
+    m_order = StreetMap::ORDER_FILE;
     
     string name;
     while(getline(infile, name)){
@@ -59,6 +144,8 @@ bool StreetMapImpl::load(string mapFile)
         numSegments = stoi(stringnum);
         //cerr << numSegments << endl;
         
+        // each street name is stored once, not once per segment, in the table commands use
+        int nameId = internCommandString(name);
         for(int i = 0; i < numSegments; i++){
             string lat1, lon1, lat2, lon2;
             infile >> lat1;
@@ -69,38 +156,514 @@ bool StreetMapImpl::load(string mapFile)
         
             GeoCoord g1(lat1, lon1);
             GeoCoord g2(lat2, lon2);
-            StreetSegment s(g1, g2, name);
-            StreetSegment rs(g2, g1, name);
+            int n1 = nodeFor(g1);
+            int n2 = nodeFor(g2);
+            double length = distanceEarthMiles(g1, g2);
             
-            insertSeg(s);
-            insertSeg(rs);
+            insertSeg(n1, n2, nameId, length);
+            insertSeg(n2, n1, nameId, length);
         }
         infile.ignore(10000, '\n');
     }
-    //cerr << m_map.size() << endl;
+    //cerr << m_nodeIds.size() << endl;
+    labelComponents();
+    classifyTurns();
+    indexStreetNames();
+    m_order = StreetMap::ORDER_FILE;
+    m_fileRank.clear();
+    TRACE_COUNT(span, "nodes", m_coords.size());
+    TRACE_COUNT(span, "edges", m_edges.size());
     return true;
 }
 
 bool StreetMapImpl::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
-    const vector<StreetSegment>* segsPtr = m_map.find(gc);
-    if(segsPtr){
-        segs = *segsPtr;
+    const int* nodePtr = m_nodeIds.find(gc);
+    if(nodePtr){
+        const vector<int>& edges = m_adjacency[*nodePtr];
+        segs.clear();
+        for(int i = 0; i < edges.size(); i++){
+            const Edge& e = m_edges[edges[i]];
+            segs.push_back(StreetSegment(m_coords[e.from], m_coords[e.to], commandString(e.name)));
+        }
+        return true;
+    }
+    return false;
+}
+
+bool StreetMapImpl::getComponentOf(const GeoCoord& gc, int& componentId) const
+{
+    const int* nodePtr = m_nodeIds.find(gc);
+    if(nodePtr){
+        componentId = m_components[*nodePtr];
+        return true;
+    }
+    return false;
+}
+
+int StreetMapImpl::edgeCount() const
+{
+    return m_edges.size();
+}
+
+bool StreetMapImpl::getEdgesThatStartWith(const GeoCoord& gc, vector<int>& edgeIds) const
+{
+    const int* nodePtr = m_nodeIds.find(gc);
+    if(nodePtr){
+        edgeIds = m_adjacency[*nodePtr];
         return true;
     }
     return false;
 }
 
-void StreetMapImpl::insertSeg(StreetSegment seg){
-    vector<StreetSegment>* segments = m_map.find(seg.start);
-     if(segments == nullptr){
-         vector<StreetSegment> newsegments;
-         newsegments.push_back(seg);
-         m_map.associate(seg.start, newsegments);
-     }
-     else{
-         segments->push_back(seg);
-     }
+bool StreetMapImpl::getSegment(int edgeId, StreetSegment& seg) const
+{
+    if(edgeId < 0 || edgeId >= m_edges.size())
+        return false;
+    const Edge& e = m_edges[edgeId];
+    seg = StreetSegment(m_coords[e.from], m_coords[e.to], commandString(e.name));
+    return true;
+}
+
+const GeoCoord& StreetMapImpl::edgeStart(int edgeId) const
+{
+    return m_coords[m_edges[edgeId].from];
+}
+
+const GeoCoord& StreetMapImpl::edgeEnd(int edgeId) const
+{
+    return m_coords[m_edges[edgeId].to];
+}
+
+double StreetMapImpl::edgeLength(int edgeId) const
+{
+    return m_edges[edgeId].length;
+}
+
+const string& StreetMapImpl::edgeName(int edgeId) const
+{
+    return commandString(m_edges[edgeId].name);
+}
+
+int StreetMapImpl::edgeNameId(int edgeId) const
+{
+    return m_edges[edgeId].name;
+}
+
+int StreetMapImpl::nodeCount() const
+{
+    return m_coords.size();
+}
+
+bool StreetMapImpl::getNodeId(const GeoCoord& gc, int& nodeId) const
+{
+    const int* nodePtr = m_nodeIds.find(gc);
+    if(nodePtr){
+        nodeId = *nodePtr;
+        return true;
+    }
+    return false;
+}
+
+const GeoCoord& StreetMapImpl::nodeCoord(int nodeId) const
+{
+    return m_coords[nodeId];
+}
+
+int StreetMapImpl::nodeComponent(int nodeId) const
+{
+    return m_components[nodeId];
+}
+
+const vector<int>& StreetMapImpl::edgesFrom(int nodeId) const
+{
+    return m_adjacency[nodeId];
+}
+
+int StreetMapImpl::edgeFrom(int edgeId) const
+{
+    return m_edges[edgeId].from;
+}
+
+int StreetMapImpl::edgeTo(int edgeId) const
+{
+    return m_edges[edgeId].to;
+}
+
+StreetMap::TurnClass StreetMapImpl::turnClass(int fromEdge, int k) const
+{
+    return StreetMap::TurnClass(m_turns[m_turnStart[fromEdge] + k]);
+}
+
+// compares a and b ignoring case, looking at no more than n characters of either
+static int compareNoCase(const string& a, const string& b, size_t n = string::npos)
+{
+    size_t length = min(n, min(a.size(), b.size()));
+    for(size_t i = 0; i < length; i++){
+        int ca = tolower((unsigned char)a[i]), cb = tolower((unsigned char)b[i]);
+        if(ca != cb)
+            return ca < cb ? -1 : 1;
+    }
+    if(length == n)
+        return 0;
+    return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+}
+
+// the streets are sorted, so the ones starting with prefix are a run found by binary search
+bool StreetMapImpl::findStreets(const string& prefix, vector<int>& nameIds) const
+{
+    nameIds.clear();
+    vector<int>::const_iterator it = lower_bound(m_streetNames.begin(), m_streetNames.end(), prefix,
+        [](int nameId, const string& p) { return compareNoCase(commandString(nameId), p, p.size()) < 0; });
+    for(; it != m_streetNames.end() && compareNoCase(commandString(*it), prefix, prefix.size()) == 0; it++)
+        nameIds.push_back(*it);
+    return !nameIds.empty();
+}
+
+bool StreetMapImpl::getStreetEdges(int nameId, vector<int>& edgeIds) const
+{
+    unordered_map<int, int>::const_iterator street = m_streetOf.find(nameId);
+    if(street == m_streetOf.end())
+        return false;
+    edgeIds.assign(m_streetEdges.begin() + m_streetStart[street->second], m_streetEdges.begin() + m_streetStart[street->second + 1]);
+    return true;
+}
+
+// s without the spaces at either end
+static string trimmed(const string& s)
+{
+    size_t start = s.find_first_not_of(" \t");
+    if(start == string::npos)
+        return "";
+    return s.substr(start, s.find_last_not_of(" \t") + 1 - start);
+}
+
+// Nodes on the side with fewer edges are sorted, and the other side's edges are looked up in
+// them.  A street both sides match only counts for the first, or "Westwood & West" would return
+// every node along Westwood Boulevard.
+bool StreetMapImpl::findIntersections(const string& streets, vector<int>& nodeIds) const
+{
+    nodeIds.clear();
+    size_t amp = streets.find('&');
+    if(amp == string::npos)
+        return false;
+    string first = trimmed(streets.substr(0, amp)), second = trimmed(streets.substr(amp + 1));
+    vector<int> firstStreets, secondStreets;
+    if(first.empty() || second.empty() || !findStreets(first, firstStreets) || !findStreets(second, secondStreets))
+        return false;
+    vector<int> others;
+    sort(firstStreets.begin(), firstStreets.end());
+    sort(secondStreets.begin(), secondStreets.end());
+    set_difference(secondStreets.begin(), secondStreets.end(), firstStreets.begin(), firstStreets.end(), back_inserter(others));
+    
+    vector<int>* small = &firstStreets;
+    vector<int>* large = &others;
+    if(streetEdgeCount(others) < streetEdgeCount(firstStreets))
+        swap(small, large);
+    vector<int> smallNodes;
+    for(int i = 0; i < small->size(); i++){
+        int street = m_streetOf.find((*small)[i])->second;
+        for(int k = m_streetStart[street]; k < m_streetStart[street + 1]; k++)
+            smallNodes.push_back(m_edges[m_streetEdges[k]].from);
+    }
+    sort(smallNodes.begin(), smallNodes.end());
+    // both directions of each segment are indexed, so the edges' start nodes are every node
+    for(int i = 0; i < large->size(); i++){
+        int street = m_streetOf.find((*large)[i])->second;
+        for(int k = m_streetStart[street]; k < m_streetStart[street + 1]; k++){
+            int node = m_edges[m_streetEdges[k]].from;
+            if(binary_search(smallNodes.begin(), smallNodes.end(), node))
+                nodeIds.push_back(node);
+        }
+    }
+    sort(nodeIds.begin(), nodeIds.end());
+    nodeIds.erase(unique(nodeIds.begin(), nodeIds.end()), nodeIds.end());
+    return !nodeIds.empty();
+}
+
+int StreetMapImpl::streetEdgeCount(const vector<int>& nameIds) const
+{
+    int count = 0;
+    for(int i = 0; i < nameIds.size(); i++){
+        int street = m_streetOf.find(nameIds[i])->second;
+        count += m_streetStart[street + 1] - m_streetStart[street];
+    }
+    return count;
+}
+
+MapMemoryReport StreetMapImpl::memoryReport() const
+{
+    MapMemoryReport report;
+    // the hash map holds its own copy of every coordinate, text included
+    size_t coordText = 0;
+    for(int i = 0; i < m_coords.size(); i++)
+        coordText += stringHeapBytes(m_coords[i].latitudeText) + stringHeapBytes(m_coords[i].longitudeText);
+    report.nodeIndex = m_nodeIds.bytesUsed() + coordText;
+    report.coordinates = vectorBytes(m_coords) + coordText + vectorBytes(m_components) + vectorBytes(m_frontier) + vectorBytes(m_fileRank);
+    report.adjacency = vectorBytes(m_adjacency);
+    for(int i = 0; i < m_adjacency.size(); i++)
+        report.adjacency += vectorBytes(m_adjacency[i]);
+    report.edges = vectorBytes(m_edges);
+    report.turns = vectorBytes(m_turnStart) + vectorBytes(m_turns);
+    // each hash map entry is a node with the pair and its next pointer, plus the cached hash
+    report.names = vectorBytes(m_streetNames) + vectorBytes(m_streetStart) + vectorBytes(m_streetEdges)
+        + m_streetOf.size() * (sizeof(pair<const int, int>) + 2 * sizeof(void*)) + m_streetOf.bucket_count() * sizeof(void*);
+    report.strings = commandStringBytes();
+    report.searchScratch = searchScratchBytes();
+    return report;
+}
+
+void StreetMapImpl::markFrontier(const function<bool(const GeoCoord&)>& outside)
+{
+    m_frontier.assign(m_coords.size(), 0);
+    for(int i = 0; i < m_coords.size(); i++)
+        m_frontier[i] = outside(m_coords[i]);
+}
+
+bool StreetMapImpl::isFrontier(int nodeId) const
+{
+    return !m_frontier.empty() && m_frontier[nodeId];
+}
+
+// Everything indexed by node or edge id is rebuilt in the new order, into fresh arrays so each
+// one's elements end up contiguous, the per-node edge lists included: they are allocated one
+// after another in node order.  Components keep their ids and turns are copied, not recomputed,
+// since every node's edges stay in the same order.
+void StreetMapImpl::reorderNodes(StreetMap::NodeOrder order){
+    TRACE_SPAN(span, "StreetMap::reorderNodes");
+    vector<int> nodes;   // new id -> old id
+    if(order == StreetMap::ORDER_HILBERT)
+        hilbertOrder(nodes);
+    else if(order == StreetMap::ORDER_BFS)
+        bfsOrder(nodes);
+    else{
+        nodes.resize(m_coords.size());
+        for(int i = 0; i < nodes.size(); i++)
+            nodes[m_fileRank.empty() ? i : m_fileRank[i]] = i;
+    }
+    int numNodes = nodes.size();
+    vector<int> newNode(numNodes), newEdge(m_edges.size());
+    int nextEdge = 0;
+    for(int i = 0; i < numNodes; i++){
+        newNode[nodes[i]] = i;
+        const vector<int>& edges = m_adjacency[nodes[i]];
+        for(int k = 0; k < edges.size(); k++)
+            newEdge[edges[k]] = nextEdge++;
+    }
+    
+    vector<GeoCoord> coords(numNodes);
+    vector<vector<int>> adjacency(numNodes);
+    vector<int> components(numNodes);
+    vector<unsigned char> frontier(m_frontier.empty() ? 0 : numNodes);
+    vector<int> fileRank(numNodes);
+    vector<Edge> edges(m_edges.size());
+    vector<int> turnStart(m_edges.size() + 1, 0);
+    vector<unsigned char> turns(m_turns.size());
+    for(int i = 0; i < numNodes; i++){
+        int old = nodes[i];
+        coords[i] = m_coords[old];
+        components[i] = m_components[old];
+        fileRank[i] = m_fileRank.empty() ? old : m_fileRank[old];
+        if(!frontier.empty())
+            frontier[i] = m_frontier[old];
+        *m_nodeIds.find(coords[i]) = i;
+        
+        const vector<int>& oldEdges = m_adjacency[old];
+        adjacency[i].reserve(oldEdges.size());
+        for(int k = 0; k < oldEdges.size(); k++){
+            int e = newEdge[oldEdges[k]];
+            adjacency[i].push_back(e);
+            edges[e] = m_edges[oldEdges[k]];
+            edges[e].from = i;
+            edges[e].to = newNode[m_edges[oldEdges[k]].to];
+            int numTurns = m_turnStart[oldEdges[k] + 1] - m_turnStart[oldEdges[k]];
+            copy(m_turns.begin() + m_turnStart[oldEdges[k]], m_turns.begin() + m_turnStart[oldEdges[k] + 1], turns.begin() + turnStart[e]);
+            turnStart[e + 1] = turnStart[e] + numTurns;
+        }
+    }
+    m_coords.swap(coords);
+    m_adjacency.swap(adjacency);
+    m_components.swap(components);
+    m_frontier.swap(frontier);
+    m_fileRank.swap(fileRank);
+    m_edges.swap(edges);
+    m_turnStart.swap(turnStart);
+    m_turns.swap(turns);
+    indexStreetNames();
+    m_order = order;
+}
+
+StreetMap::NodeOrder StreetMapImpl::nodeOrder() const
+{
+    return m_order;
+}
+
+// Nodes sorted by their position along a Hilbert curve through a 2^16 by 2^16 grid over the
+// map's bounding box; ties, which only close neighbors have, keep their current order.
+void StreetMapImpl::hilbertOrder(vector<int>& nodes) const{
+    int numNodes = m_coords.size();
+    double minLat = 90, maxLat = -90, minLon = 180, maxLon = -180;
+    for(int i = 0; i < numNodes; i++){
+        minLat = min(minLat, m_coords[i].latitude);
+        maxLat = max(maxLat, m_coords[i].latitude);
+        minLon = min(minLon, m_coords[i].longitude);
+        maxLon = max(maxLon, m_coords[i].longitude);
+    }
+    const unsigned side = 1 << 16;
+    double latScale = maxLat > minLat ? (side - 1) / (maxLat - minLat) : 0;
+    double lonScale = maxLon > minLon ? (side - 1) / (maxLon - minLon) : 0;
+    vector<pair<unsigned long long, int>> keyed(numNodes);
+    for(int i = 0; i < numNodes; i++){
+        unsigned x = unsigned((m_coords[i].longitude - minLon) * lonScale);
+        unsigned y = unsigned((m_coords[i].latitude - minLat) * latScale);
+        unsigned long long d = 0;
+        for(unsigned s = side / 2; s > 0; s /= 2){   // the usual xy-to-distance walk, rotating each quadrant
+            unsigned rx = (x & s) > 0, ry = (y & s) > 0;
+            d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+            if(ry == 0){
+                if(rx == 1){
+                    x = side - 1 - x;
+                    y = side - 1 - y;
+                }
+                swap(x, y);
+            }
+        }
+        keyed[i] = make_pair(d, i);
+    }
+    sort(keyed.begin(), keyed.end());
+    nodes.resize(numNodes);
+    for(int i = 0; i < numNodes; i++)
+        nodes[i] = keyed[i].second;
+}
+
+// Breadth first from the lowest-numbered node of each component in turn, visiting each node's
+// neighbors in the order of its edges.
+void StreetMapImpl::bfsOrder(vector<int>& nodes) const{
+    int numNodes = m_coords.size();
+    vector<bool> seen(numNodes, false);
+    nodes.clear();
+    nodes.reserve(numNodes);
+    for(int root = 0; root < numNodes; root++){
+        if(seen[root])
+            continue;
+        seen[root] = true;
+        nodes.push_back(root);
+        for(int head = nodes.size() - 1; head < nodes.size(); head++){
+            const vector<int>& edges = m_adjacency[nodes[head]];
+            for(int k = 0; k < edges.size(); k++){
+                int next = m_edges[edges[k]].to;
+                if(!seen[next]){
+                    seen[next] = true;
+                    nodes.push_back(next);
+                }
+            }
+        }
+    }
+}
+
+// returns the id of gc's node, creating the node the first time gc is seen
+int StreetMapImpl::nodeFor(const GeoCoord& gc){
+    const int* nodePtr = m_nodeIds.find(gc);
+    if(nodePtr)
+        return *nodePtr;
+    int node = m_coords.size();
+    m_nodeIds.associate(gc, node);
+    m_coords.push_back(gc);
+    m_adjacency.push_back(vector<int>());
+    return node;
+}
+
+void StreetMapImpl::insertSeg(int from, int to, int name, double length){
+    Edge e;
+    e.from = from;
+    e.to = to;
+    e.name = name;
+    e.length = length;
+    m_adjacency[from].push_back(m_edges.size());
+    m_edges.push_back(e);
+}
+
+// Flood fills the map once at load time so that routers can reject unreachable pairs without searching.
+// Every segment is inserted in both directions, so plain connected components are also the strongly
+// connected ones; if one-way streets are ever loaded this needs to become Tarjan's SCC.
+void StreetMapImpl::labelComponents(){
+    m_components.assign(m_coords.size(), -1);
+    int nextComponent = 0;
+    for(int i = 0; i < m_coords.size(); i++){
+        if(m_components[i] != -1)   // already reached from an earlier node
+            continue;
+        
+        vector<int> toVisit;
+        toVisit.push_back(i);
+        m_components[i] = nextComponent;
+        while(!toVisit.empty()){
+            int cur = toVisit.back();
+            toVisit.pop_back();
+            const vector<int>& edges = m_adjacency[cur];
+            for(int k = 0; k < edges.size(); k++){
+                int next = m_edges[edges[k]].to;
+                if(m_components[next] == -1){
+                    m_components[next] = nextComponent;
+                    toVisit.push_back(next);
+                }
+            }
+        }
+        nextComponent++;
+    }
+}
+
+// One byte per pair of consecutive edges, laid out edge by edge in the order of the successors
+// in m_adjacency, so a turn is found from the edge and the successor's index alone.
+void StreetMapImpl::classifyTurns(){
+    m_turnStart.assign(m_edges.size() + 1, 0);
+    for(int e = 0; e < m_edges.size(); e++)
+        m_turnStart[e + 1] = m_turnStart[e] + m_adjacency[m_edges[e].to].size();
+    m_turns.assign(m_turnStart.back(), StreetMap::TURN_STRAIGHT);
+    
+    for(int e = 0; e < m_edges.size(); e++){
+        StreetSegment in(m_coords[m_edges[e].from], m_coords[m_edges[e].to], "");
+        const vector<int>& next = m_adjacency[m_edges[e].to];
+        for(int k = 0; k < next.size(); k++){
+            StreetSegment out(m_coords[m_edges[next[k]].from], m_coords[m_edges[next[k]].to], "");
+            double angle = angleBetween2Lines(in, out);
+            StreetMap::TurnClass turn;
+            if(angle < 30 || angle > 330)
+                turn = StreetMap::TURN_STRAIGHT;
+            else if(angle < 150)
+                turn = StreetMap::TURN_LEFT;
+            else if(angle <= 210)
+                turn = StreetMap::TURN_U;
+            else
+                turn = StreetMap::TURN_RIGHT;
+            m_turns[m_turnStart[e] + k] = turn;
+        }
+    }
+}
+
+// The names this map's edges use, sorted ignoring case, and each one's edges grouped together
+// by a counting sort, so a name's edges are one slice of m_streetEdges.
+void StreetMapImpl::indexStreetNames(){
+    m_streetNames.clear();
+    m_streetOf.clear();
+    for(int e = 0; e < m_edges.size(); e++)
+        if(m_streetOf.insert(make_pair(m_edges[e].name, 0)).second)
+            m_streetNames.push_back(m_edges[e].name);
+    sort(m_streetNames.begin(), m_streetNames.end(), [](int a, int b) {
+        int order = compareNoCase(commandString(a), commandString(b));
+        return order != 0 ? order < 0 : a < b;
+    });
+    for(int i = 0; i < m_streetNames.size(); i++)
+        m_streetOf[m_streetNames[i]] = i;
+    
+    m_streetStart.assign(m_streetNames.size() + 1, 0);
+    for(int e = 0; e < m_edges.size(); e++)
+        m_streetStart[m_streetOf[m_edges[e].name] + 1]++;
+    for(int i = 0; i < m_streetNames.size(); i++)
+        m_streetStart[i + 1] += m_streetStart[i];
+    vector<int> next(m_streetStart.begin(), m_streetStart.end() - 1);
+    m_streetEdges.resize(m_edges.size());
+    for(int e = 0; e < m_edges.size(); e++)
+        m_streetEdges[next[m_streetOf[m_edges[e].name]]++] = e;
 }
 
 //******************** StreetMap functions ************************************
@@ -123,7 +686,137 @@ bool StreetMap::load(string mapFile)
     return m_impl->load(mapFile);
 }
 
+bool StreetMap::load(istream& in)
+{
+    return m_impl->load(in);
+}
+
 bool StreetMap::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
    return m_impl->getSegmentsThatStartWith(gc, segs);
 }
+
+bool StreetMap::getComponentOf(const GeoCoord& gc, int& componentId) const
+{
+   return m_impl->getComponentOf(gc, componentId);
+}
+
+int StreetMap::edgeCount() const
+{
+    return m_impl->edgeCount();
+}
+
+bool StreetMap::getEdgesThatStartWith(const GeoCoord& gc, vector<int>& edgeIds) const
+{
+    return m_impl->getEdgesThatStartWith(gc, edgeIds);
+}
+
+bool StreetMap::getSegment(int edgeId, StreetSegment& seg) const
+{
+    return m_impl->getSegment(edgeId, seg);
+}
+
+const GeoCoord& StreetMap::edgeStart(int edgeId) const
+{
+    return m_impl->edgeStart(edgeId);
+}
+
+const GeoCoord& StreetMap::edgeEnd(int edgeId) const
+{
+    return m_impl->edgeEnd(edgeId);
+}
+
+double StreetMap::edgeLength(int edgeId) const
+{
+    return m_impl->edgeLength(edgeId);
+}
+
+const string& StreetMap::edgeName(int edgeId) const
+{
+    return m_impl->edgeName(edgeId);
+}
+
+int StreetMap::edgeNameId(int edgeId) const
+{
+    return m_impl->edgeNameId(edgeId);
+}
+
+int StreetMap::nodeCount() const
+{
+    return m_impl->nodeCount();
+}
+
+bool StreetMap::getNodeId(const GeoCoord& gc, int& nodeId) const
+{
+    return m_impl->getNodeId(gc, nodeId);
+}
+
+const GeoCoord& StreetMap::nodeCoord(int nodeId) const
+{
+    return m_impl->nodeCoord(nodeId);
+}
+
+int StreetMap::nodeComponent(int nodeId) const
+{
+    return m_impl->nodeComponent(nodeId);
+}
+
+const vector<int>& StreetMap::edgesFrom(int nodeId) const
+{
+    return m_impl->edgesFrom(nodeId);
+}
+
+int StreetMap::edgeFrom(int edgeId) const
+{
+    return m_impl->edgeFrom(edgeId);
+}
+
+int StreetMap::edgeTo(int edgeId) const
+{
+    return m_impl->edgeTo(edgeId);
+}
+
+StreetMap::TurnClass StreetMap::turnClass(int fromEdge, int k) const
+{
+    return m_impl->turnClass(fromEdge, k);
+}
+
+bool StreetMap::findStreets(const string& prefix, vector<int>& nameIds) const
+{
+    return m_impl->findStreets(prefix, nameIds);
+}
+
+bool StreetMap::getStreetEdges(int nameId, vector<int>& edgeIds) const
+{
+    return m_impl->getStreetEdges(nameId, edgeIds);
+}
+
+bool StreetMap::findIntersections(const string& streets, vector<int>& nodeIds) const
+{
+    return m_impl->findIntersections(streets, nodeIds);
+}
+
+void StreetMap::reorderNodes(NodeOrder order)
+{
+    m_impl->reorderNodes(order);
+}
+
+StreetMap::NodeOrder StreetMap::nodeOrder() const
+{
+    return m_impl->nodeOrder();
+}
+
+MapMemoryReport StreetMap::memoryReport() const
+{
+    return m_impl->memoryReport();
+}
+
+void StreetMap::markFrontier(const function<bool(const GeoCoord&)>& outside)
+{
+    m_impl->markFrontier(outside);
+}
+
+bool StreetMap::isFrontier(int nodeId) const
+{
+    return m_impl->isFrontier(nodeId);
+}
@@ -0,0 +1,261 @@
+#include "SyntheticCity.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+static const double ORIGIN_LAT = 34.0;      // south-west corner, near the bundled map
+static const double ORIGIN_LON = -118.6;
+static const double BLOCK_LAT = 0.0009;     // about 100 meters
+static const double BLOCK_LON = 0.0011;
+static const int ARTERIAL_EVERY = 10;
+static const int ISLAND_GAP = 5;            // blocks of nothing between the city and each island
+
+static const char* const NAMES[] = {
+    "Wilshire", "Olympic", "Pico", "Sunset", "Santa Monica", "Venice", "Washington", "Jefferson",
+    "Exposition", "Rodeo", "Sepulveda", "Westwood", "Barrington", "Bundy", "Centinela", "Overland",
+    "Robertson", "La Cienega", "Fairfax", "Highland", "Vermont", "Western", "Crenshaw", "Hauser"
+};
+static const int NUM_NAMES = sizeof(NAMES) / sizeof(NAMES[0]);
+
+// splitmix64's finalizer, so a block's fate depends only on the seed and where it is
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static string ordinal(int n)
+{
+    const char* suffix = "th";
+    if (n % 100 < 11 || n % 100 > 13)
+    {
+        if (n % 10 == 1)
+            suffix = "st";
+        else if (n % 10 == 2)
+            suffix = "nd";
+        else if (n % 10 == 3)
+            suffix = "rd";
+    }
+    return to_string(n) + suffix;
+}
+
+// Where everything in the city is, worked out from the options alone.  The main grid is rows and
+// columns 0 to size()-1; island k is a grid of islandSize() blocks starting at row islandRow(k).
+class CityLayout
+{
+public:
+    CityLayout(const CityOptions& city)
+     : m_city(city)
+    {
+        // kept blocks of the grid, plus the parkways and islands, in units of size^2
+        double perSquare = 2 * (1 - 0.8 * city.removedFraction) + 1.0 / 40 + city.islands * 2.0 / 625;
+        m_size = max(4, int(sqrt(max(1L, city.segments) / perSquare)));
+        m_islandSize = max(3, m_size / 25);
+    }
+
+    int size() const { return m_size; }
+    int islandSize() const { return m_islandSize; }
+    int islandRow(int k) const { return m_size + ISLAND_GAP + k * (m_islandSize + ISLAND_GAP); }
+
+    static bool arterial(int line) { return line % ARTERIAL_EVERY == 0; }
+
+    // a block of the main grid east from (row, col) or north from it; arterials are never cut
+    bool eastKept(int row, int col) const
+    {
+        return arterial(row) || unit(row, col, 1) >= m_city.removedFraction;
+    }
+    bool northKept(int row, int col) const
+    {
+        return arterial(col) || unit(row, col, 2) >= m_city.removedFraction;
+    }
+
+    // whether some kept block of the main grid ends at (row, col), making it a node of the map
+    bool isIntersection(int row, int col) const
+    {
+        return (col + 1 < m_size && eastKept(row, col)) || (col > 0 && eastKept(row, col - 1))
+            || (row + 1 < m_size && northKept(row, col)) || (row > 0 && northKept(row - 1, col));
+    }
+
+    // "lat lon" of the intersection, with the map file's seven decimals
+    void appendCoord(int row, int col, string& out) const
+    {
+        double lat = ORIGIN_LAT + (row + (unit(row, col, 3) - 0.5) * m_city.jitter) * BLOCK_LAT;
+        double lon = ORIGIN_LON + (col + (unit(row, col, 4) - 0.5) * m_city.jitter) * BLOCK_LON;
+        char text[48];
+        snprintf(text, sizeof(text), "%.7f %.7f", lat, lon);
+        out += text;
+    }
+
+private:
+    const CityOptions& m_city;
+    int m_size;
+    int m_islandSize;
+
+    double unit(int row, int col, int salt) const   // in [0, 1)
+    {
+        uint64_t key = (uint64_t(m_city.seed) << 40) ^ (uint64_t(uint32_t(row)) << 20) ^ uint64_t(uint32_t(col)) ^ (uint64_t(salt) << 60);
+        return (mix(key) >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+// Writes streets one run at a time.  A run is a record of the map file: the street's name, the
+// number of segments, then the segments.  Runs stop at a missing block and otherwise after a
+// random 5 to 60 blocks, so one street spans several records the way the bundled map's do.
+class CityWriter
+{
+public:
+    CityWriter(ostream& out, const CityLayout& layout, unsigned seed)
+     : m_out(out), m_layout(layout), m_rng(seed), m_segments(0)
+    {}
+
+    long segments() const { return m_segments; }
+
+    // blocks steps of (dRow, dCol) from (row, col); cuttable streets lose the blocks the layout
+    // leaves out, which only makes sense on the main grid's rows and columns
+    void writeStreet(const string& name, int row, int col, int dRow, int dCol, int blocks, bool cuttable)
+    {
+        uniform_int_distribution<int> runLength(5, 60);
+        int count = 0, limit = runLength(m_rng);
+        m_run.clear();
+        for (int b = 0; b < blocks; b++, row += dRow, col += dCol)
+        {
+            bool kept = !cuttable || (dRow == 0 ? m_layout.eastKept(row, col) : m_layout.northKept(row, col));
+            if (!kept || count == limit)
+            {
+                flush(name, count);
+                count = 0;
+                limit = runLength(m_rng);
+                if (!kept)
+                    continue;
+            }
+            m_layout.appendCoord(row, col, m_run);
+            m_run += ' ';
+            m_layout.appendCoord(row + dRow, col + dCol, m_run);
+            m_run += '\n';
+            count++;
+        }
+        flush(name, count);
+    }
+
+private:
+    ostream& m_out;
+    const CityLayout& m_layout;
+    mt19937 m_rng;
+    long m_segments;
+    string m_run;   // the segments of the run being built, already formatted
+
+    void flush(const string& name, int count)
+    {
+        if (count > 0)
+        {
+            m_out << name << '\n' << count << '\n' << m_run;
+            m_segments += count;
+        }
+        m_run.clear();
+    }
+};
+
+long writeSyntheticCity(ostream& out, const CityOptions& city)
+{
+    CityLayout layout(city);
+    CityWriter writer(out, layout, city.seed);
+    int n = layout.size();
+
+    for (int row = 0; row < n; row++)
+    {
+        string name = CityLayout::arterial(row) ? string(NAMES[(row / ARTERIAL_EVERY) % NUM_NAMES]) + " Boulevard" : ordinal(row + 1) + " Street";
+        writer.writeStreet(name, row, 0, 0, 1, n - 1, true);
+    }
+    for (int col = 0; col < n; col++)
+    {
+        string name = CityLayout::arterial(col) ? string(NAMES[(col / ARTERIAL_EVERY + 7) % NUM_NAMES]) + " Drive" : ordinal(col + 1) + " Avenue";
+        writer.writeStreet(name, 0, col, 1, 0, n - 1, true);
+    }
+
+    // parkways from the south edge, alternately heading north-east and north-west
+    int numParkways = max(1, n / 40);
+    for (int d = 0; d < numParkways; d++)
+    {
+        int col = (d + 1) * (n - 1) / (numParkways + 1);
+        int dCol = d % 2 == 0 ? 1 : -1;
+        int blocks = min(n - 1, dCol > 0 ? n - 1 - col : col);
+        writer.writeStreet(string(NAMES[(d * 5 + 3) % NUM_NAMES]) + " Parkway", 0, col, 1, dCol, blocks, false);
+    }
+
+    for (int k = 0; k < city.islands; k++)
+    {
+        int top = layout.islandRow(k), s = layout.islandSize();
+        for (int r = 0; r < s; r++)
+            writer.writeStreet(string(NAMES[(k + r) % NUM_NAMES]) + " Lane", top + r, 0, 0, 1, s - 1, false);
+        for (int c = 0; c < s; c++)
+            writer.writeStreet(string(NAMES[(k + c) % NUM_NAMES]) + " Court", top, c, 1, 0, s - 1, false);
+    }
+    return writer.segments();
+}
+
+void writeSyntheticDeliveries(ostream& out, const CityOptions& city, const WorkloadOptions& workload)
+{
+    CityLayout layout(city);
+    int n = layout.size();
+    mt19937 rng(workload.seed);
+    uniform_int_distribution<int> anywhere(0, n - 1);
+    normal_distribution<double> spread(0, workload.clusterRadius);
+
+    // the nearest intersection along the row, searching outward from col
+    auto snap = [&](int row, int& col) {
+        for (int d = 0; d < n; d++)
+        {
+            if (col + d < n && layout.isIntersection(row, col + d))
+            {
+                col += d;
+                return true;
+            }
+            if (col - d >= 0 && layout.isIntersection(row, col - d))
+            {
+                col -= d;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    string line;
+    // on an arterial near the middle, which is never cut, so the depot is always reachable
+    int depotRow = n / 2 - (n / 2) % ARTERIAL_EVERY, depotCol = n / 2;
+    snap(depotRow, depotCol);
+    layout.appendCoord(depotRow, depotCol, line);
+    out << line << '\n';
+
+    vector<pair<int, int>> centers;
+    for (int c = 0; c < workload.clusters; c++)
+        centers.push_back(make_pair(anywhere(rng), anywhere(rng)));
+
+    for (int i = 0; i < workload.stops; )
+    {
+        int row, col;
+        if (centers.empty())
+        {
+            row = anywhere(rng);
+            col = anywhere(rng);
+        }
+        else
+        {
+            const pair<int, int>& center = centers[i % centers.size()];
+            row = min(n - 1, max(0, int(lround(center.first + spread(rng)))));
+            col = min(n - 1, max(0, int(lround(center.second + spread(rng)))));
+        }
+        if (!snap(row, col))
+            continue;
+        line.clear();
+        layout.appendCoord(row, col, line);
+        out << line << ":Package " << ++i << '\n';
+    }
+}
@@ -0,0 +1,49 @@
+// SyntheticCity.h
+
+// Generated maps and delivery files, in the same formats as mapdata.txt and deliveries.txt, for
+// exercising the code at sizes the bundled map doesn't reach.  The city is a grid of blocks
+// around the bundled map's area.  Intersections are nudged off the grid, a share of blocks is
+// left out to make dead ends, and every tenth street is an arterial that is never cut.
+// Diagonal parkways cross the grid, and a few small neighborhoods connect to nothing else.
+// Streets are long and named like real ones, and each is written as runs of many segments
+// under the same name.
+//
+// Everything comes from the seed, and nothing is kept in memory while writing, so a map with
+// millions of segments costs no more memory than a small one.
+
+#ifndef SYNTHETICCITY_INCLUDED
+#define SYNTHETICCITY_INCLUDED
+
+#include <iostream>
+
+struct CityOptions
+{
+    CityOptions()
+     : segments(50000), seed(42), islands(4), removedFraction(0.08), jitter(0.2)
+    {}
+    long segments;            // roughly how many to write; each becomes two edges when loaded
+    unsigned seed;
+    int islands;              // neighborhoods unreachable from the rest of the city
+    double removedFraction;   // share of non-arterial blocks left out
+    double jitter;            // how far intersections stray from the grid, in blocks
+};
+
+struct WorkloadOptions
+{
+    WorkloadOptions()
+     : stops(20), clusters(3), clusterRadius(8), seed(7)
+    {}
+    int stops;
+    int clusters;             // stops gather around this many centers; 0 spreads them evenly
+    double clusterRadius;     // standard deviation of a stop's distance from its center, in blocks
+    unsigned seed;
+};
+
+  // Writes a map; returns the number of segments written.
+long writeSyntheticCity(std::ostream& out, const CityOptions& city);
+
+  // Writes a deliveries file whose depot and stops are intersections of the map the same
+  // CityOptions produce, all in the main part of the city.
+void writeSyntheticDeliveries(std::ostream& out, const CityOptions& city, const WorkloadOptions& workload);
+
+#endif // SYNTHETICCITY_INCLUDED
@@ -0,0 +1,244 @@
+// ThreadPool.h
+
+// A small work-stealing thread pool.  Every worker owns a deque of tasks: it pushes and pops
+// its own work at the back and, when that runs dry, steals from the front of the others'.
+// Tasks submitted from outside the pool are dealt round-robin across the workers.
+//
+// Use a TaskGroup to wait for a batch of tasks.  Waiting from inside a pool task is fine; the
+// waiting thread runs queued tasks itself instead of blocking, so nested groups can't deadlock.
+
+#ifndef THREADPOOL_INCLUDED
+#define THREADPOOL_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+      // numThreads <= 0 means one per hardware thread
+    explicit ThreadPool(int numThreads = 0)
+     : m_stopping(false), m_queued(0), m_nextQueue(0)
+    {
+        if (numThreads <= 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        m_queues.resize(numThreads);
+        for (int i = 0; i < numThreads; i++)
+            m_queues[i] = new WorkQueue;
+        for (int i = 0; i < numThreads; i++)
+            m_workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_stopping = true;
+        }
+        m_wakeUp.notify_all();
+        for (size_t i = 0; i < m_workers.size(); i++)
+            m_workers[i].join();
+        for (size_t i = 0; i < m_queues.size(); i++)
+            delete m_queues[i];
+    }
+
+      // one pool per process, for code that wants to run work in parallel without owning
+      // threads of its own; created on first use
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    int size() const
+    {
+        return m_workers.size();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        int queue = currentWorker();
+        if (queue < 0)
+            queue = m_nextQueue++ % m_queues.size();
+        {
+            std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+            m_queues[queue]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_queued++;
+        }
+        m_wakeUp.notify_one();
+    }
+
+      // runs one queued task on the calling thread; false if there was nothing to run
+    bool runPendingTask()
+    {
+        std::function<void()> task;
+        if (!takeTask(currentWorker(), task))
+            return false;
+        task();
+        return true;
+    }
+
+      // index of the pool worker running the calling thread, or -1 for any other thread
+    int currentWorker() const
+    {
+        return workerPool() == this ? workerIndex() : -1;
+    }
+
+      // We prevent a ThreadPool object from being copied or assigned.
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread>  m_workers;
+    std::vector<WorkQueue*>   m_queues;
+    std::mutex                m_sleepMutex;
+    std::condition_variable   m_wakeUp;
+    bool                      m_stopping;
+    int                       m_queued;      // tasks submitted but not yet taken, under m_sleepMutex
+    std::atomic<unsigned>     m_nextQueue;
+
+      // which pool and worker the calling thread belongs to, if any
+    static const ThreadPool*& workerPool()
+    {
+        static thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static int& workerIndex()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+      // own queue first (newest task, still warm in cache), then the oldest task of another queue
+    bool takeTask(int self, std::function<void()>& task)
+    {
+        int n = m_queues.size();
+        if (self >= 0)
+        {
+            WorkQueue* q = m_queues[self];
+            std::lock_guard<std::mutex> lock(q->mutex);
+            if (!q->tasks.empty())
+            {
+                task = std::move(q->tasks.back());
+                q->tasks.pop_back();
+                taken();
+                return true;
+            }
+        }
+        int start = self >= 0 ? self + 1 : 0;
+        for (int k = 0; k < n; k++)
+        {
+            WorkQueue* q = m_queues[(start + k) % n];
+            std::lock_guard<std::mutex> lock(q->mutex);
+            if (!q->tasks.empty())
+            {
+                task = std::move(q->tasks.front());
+                q->tasks.pop_front();
+                taken();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void taken()
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_queued--;
+    }
+
+    void workerLoop(int self)
+    {
+        workerPool() = this;
+        workerIndex() = self;
+        for (;;)
+        {
+            std::function<void()> task;
+            if (takeTask(self, task))
+            {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_wakeUp.wait(lock, [this] { return m_stopping || m_queued > 0; });
+            if (m_stopping && m_queued == 0)
+                return;
+        }
+    }
+};
+
+  // A batch of tasks on a ThreadPool that can be waited for as a whole.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool& pool)
+     : m_pool(pool), m_pending(0)
+    {}
+
+    ~TaskGroup()
+    {
+        wait();
+    }
+
+    void run(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending++;
+        }
+        m_pool.submit([this, task]() {
+            task();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0)
+                m_done.notify_all();
+        });
+    }
+
+      // helps with queued work until every task run through this group has finished
+    void wait()
+    {
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_pending == 0)
+                    return;
+            }
+            if (!m_pool.runPendingTask())
+            {
+                  // nothing left to help with, so our tasks are running elsewhere
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait_for(lock, std::chrono::milliseconds(1), [this] { return m_pending == 0; });
+            }
+        }
+    }
+
+      // We prevent a TaskGroup object from being copied or assigned.
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+private:
+    ThreadPool&             m_pool;
+    std::mutex              m_mutex;
+    std::condition_variable m_done;
+    int                     m_pending;
+};
+
+#endif // THREADPOOL_INCLUDED
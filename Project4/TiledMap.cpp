@@ -0,0 +1,315 @@
+#include "TiledMap.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <sys/stat.h>
+using namespace std;
+
+TiledMap::TiledMap(double tileDegrees, int maxCachedTiles)
+ : m_tileDegrees(tileDegrees), m_maxCachedTiles(max(1, maxCachedTiles)), m_tilesLoaded(0), m_expansions(0)
+{
+}
+
+// the file's modification time in nanoseconds, or -1 if it can't be had
+static long long modificationTime(const string& path)
+{
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0)
+        return -1;
+#ifdef __APPLE__
+    return info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+    return info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+}
+
+bool TiledMap::open(const string& mapFile, const string& indexFile)
+{
+    m_index.clear();
+    m_cache.clear();
+    m_lru.clear();
+    m_map.reset();
+    m_file.close();
+    m_file.clear();
+    m_file.open(mapFile);
+    if(!m_file)
+        return false;
+    m_mapFile = mapFile;
+    m_file.seekg(0, ios::end);
+    long fileSize = m_file.tellg();
+    m_file.seekg(0);
+    long long modified = modificationTime(mapFile);
+
+    // an index left by an earlier run is only trusted if it was built for this file, as it is
+    // now, at this tile size; an edit that keeps the size still changes the modification time
+    string indexPath = indexFile.empty() ? mapFile + ".tiles" : indexFile;
+    if(modified >= 0 && readIndex(indexPath, fileSize, modified))
+        return true;
+    if(!buildIndex(fileSize))
+        return false;
+    if(modified >= 0)
+        writeIndex(indexPath, fileSize, modified);   // if it can't be saved, the next open just builds it again
+    return true;
+}
+
+DeliveryResult TiledMap::generateDeliveryPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    vector<DeliveryCommand>& commands,
+    double& totalDistanceTravelled)
+{
+    unordered_set<TileKey> tiles;
+    tiles.insert(tileOf(depot));
+    for(int i = 0; i < deliveries.size(); i++)
+        tiles.insert(tileOf(deliveries[i].location));
+    addRing(tiles);
+    m_expansions = 0;
+
+    for(;;){
+        if(!loadTiles(tiles))
+            return BAD_COORD;
+        DeliveryPlanner planner(m_map.get());
+        vector<StreetRoute> legs;
+        commands.clear();
+        DeliveryResult result = planner.generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled, legs);
+
+        size_t before = tiles.size();
+        if(result == DELIVERY_SUCCESS){
+            // any tile a search reached the edge of might hold a shorter way
+            for(int i = 0; i < legs.size(); i++){
+                const vector<int>& frontier = legs[i].frontierNodes();
+                for(int k = 0; k < frontier.size(); k++)
+                    tiles.insert(tileOf(m_map->nodeCoord(frontier[k])));
+            }
+        }
+        else if(result == NO_ROUTE){
+            if(provablyDisconnected(depot, deliveries))
+                return result;
+            addRing(tiles);   // the stops may yet connect through streets further out
+        }
+        if(tiles.size() == before || m_tilesLoaded == m_index.size())
+            return result;
+        m_expansions++;
+    }
+}
+
+int TiledMap::tileCount() const
+{
+    return m_index.size();
+}
+
+int TiledMap::tilesLoaded() const
+{
+    return m_tilesLoaded;
+}
+
+int TiledMap::expansions() const
+{
+    return m_expansions;
+}
+
+int TiledMap::cachedTiles() const
+{
+    return m_cache.size();
+}
+
+const StreetMap* TiledMap::lastMap() const
+{
+    return m_map.get();
+}
+
+// row in the high half, column in the low half
+static long long tileKey(long long row, long long col)
+{
+    return (long long)(((unsigned long long)row << 32) | (unsigned long long)(uint32_t)col);
+}
+
+TiledMap::TileKey TiledMap::tileOf(double lat, double lon) const
+{
+    return tileKey((long long)floor(lat / m_tileDegrees), (long long)floor(lon / m_tileDegrees));
+}
+
+TiledMap::TileKey TiledMap::tileOf(const GeoCoord& gc) const
+{
+    return tileOf(gc.latitude, gc.longitude);
+}
+
+// One pass over the file noting where each street record starts and which tiles its segments'
+// ends fall in.  Records are read the way StreetMap::load reads them.
+bool TiledMap::buildIndex(long fileSize)
+{
+    string name, countLine, line;
+    vector<TileKey> touched;
+    for(;;){
+        long offset = m_file.tellg();
+        if(!getline(m_file, name) || !getline(m_file, countLine) || countLine.empty())
+            break;
+        int count = atoi(countLine.c_str());
+        touched.clear();
+        for(int i = 0; i < count && getline(m_file, line); i++){
+            double lat1, lon1, lat2, lon2;
+            if(sscanf(line.c_str(), "%lf %lf %lf %lf", &lat1, &lon1, &lat2, &lon2) != 4)
+                continue;
+            TileKey ends[2] = { tileOf(lat1, lon1), tileOf(lat2, lon2) };
+            for(int e = 0; e < 2; e++){
+                if(find(touched.begin(), touched.end(), ends[e]) == touched.end())
+                    touched.push_back(ends[e]);
+            }
+        }
+        for(int i = 0; i < touched.size(); i++)
+            m_index[touched[i]].push_back(offset);
+    }
+    m_file.clear();
+    return !m_index.empty() || fileSize == 0;
+}
+
+// "GTI2 tileDegrees fileSize modified", then a line per tile: its key, the number of records,
+// their offsets
+bool TiledMap::readIndex(const string& indexFile, long fileSize, long long modified)
+{
+    ifstream in(indexFile);
+    string magic;
+    double degrees;
+    long size;
+    long long time;
+    if(!(in >> magic >> degrees >> size >> time) || magic != "GTI2" || fabs(degrees - m_tileDegrees) > 1e-12 ||
+       size != fileSize || time != modified)
+        return false;
+    TileKey key;
+    int count;
+    while(in >> key >> count){
+        vector<long>& offsets = m_index[key];
+        offsets.resize(count);
+        for(int i = 0; i < count; i++)
+            in >> offsets[i];
+    }
+    if(!in.eof()){
+        m_index.clear();
+        return false;
+    }
+    return true;
+}
+
+bool TiledMap::writeIndex(const string& indexFile, long fileSize, long long modified) const
+{
+    ofstream out(indexFile);
+    out.precision(17);
+    out << "GTI2 " << m_tileDegrees << " " << fileSize << " " << modified << "\n";
+    for(unordered_map<TileKey, vector<long>>::const_iterator it = m_index.begin(); it != m_index.end(); it++){
+        out << it->first << " " << it->second.size();
+        for(int i = 0; i < it->second.size(); i++)
+            out << " " << it->second[i];
+        out << "\n";
+    }
+    return bool(out);
+}
+
+// from the cache if it's there, otherwise from the file, evicting the least recently used
+// tiles past the limit; a tile nobody indexed comes back empty
+shared_ptr<const TiledMap::Tile> TiledMap::tile(TileKey key)
+{
+    auto cached = m_cache.find(key);
+    if(cached != m_cache.end()){
+        m_lru.splice(m_lru.begin(), m_lru, cached->second.second);
+        return cached->second.first;
+    }
+
+    shared_ptr<Tile> t(new Tile);
+    auto indexed = m_index.find(key);
+    if(indexed != m_index.end()){
+        string line;
+        for(int i = 0; i < indexed->second.size(); i++){
+            long offset = indexed->second[i];
+            m_file.clear();
+            m_file.seekg(offset);
+            string record, countLine;
+            getline(m_file, record);
+            getline(m_file, countLine);
+            record += '\n';
+            record += countLine;
+            record += '\n';
+            int count = atoi(countLine.c_str());
+            for(int k = 0; k < count && getline(m_file, line); k++){
+                record += line;
+                record += '\n';
+            }
+            t->offsets.push_back(offset);
+            t->records.push_back(record);
+        }
+    }
+
+    m_lru.push_front(key);
+    m_cache[key] = make_pair(shared_ptr<const Tile>(t), m_lru.begin());
+    while(m_cache.size() > m_maxCachedTiles){
+        m_cache.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+    return t;
+}
+
+// Builds a fresh map from every record of the tiles, each record once however many of the
+// tiles it crosses, and marks the nodes outside them as the frontier.
+bool TiledMap::loadTiles(const unordered_set<TileKey>& tiles)
+{
+    string text;
+    unordered_set<long> seen;
+    m_tilesLoaded = 0;
+    for(unordered_set<TileKey>::const_iterator it = tiles.begin(); it != tiles.end(); it++){
+        shared_ptr<const Tile> t = tile(*it);
+        if(!t->offsets.empty())
+            m_tilesLoaded++;
+        for(int i = 0; i < t->offsets.size(); i++){
+            if(seen.insert(t->offsets[i]).second)
+                text += t->records[i];
+        }
+    }
+
+    m_map.reset(new StreetMap);
+    istringstream in(text);
+    if(!m_map->load(in))
+        return false;
+    m_map->markFrontier([this, &tiles](const GeoCoord& gc) {
+        return tiles.count(tileOf(gc)) == 0;
+    });
+    return true;
+}
+
+// True if some stop can't reach the depot in the whole map either: it's in a different part of
+// the loaded map, and one of the two parts has no frontier, so no street left out can join them.
+bool TiledMap::provablyDisconnected(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries) const
+{
+    vector<bool> open;   // component id -> has a frontier node
+    for(int node = 0; node < m_map->nodeCount(); node++){
+        int component = m_map->nodeComponent(node);
+        if(component >= open.size())
+            open.resize(component + 1, false);
+        if(m_map->isFrontier(node))
+            open[component] = true;
+    }
+    int depotComponent;
+    if(!m_map->getComponentOf(depot, depotComponent))
+        return false;
+    for(int i = 0; i < deliveries.size(); i++){
+        int component;
+        if(m_map->getComponentOf(deliveries[i].location, component) && component != depotComponent &&
+           (!open[component] || !open[depotComponent]))
+            return true;
+    }
+    return false;
+}
+
+// adds every tile touching one already in the set
+void TiledMap::addRing(unordered_set<TileKey>& tiles) const
+{
+    vector<TileKey> current(tiles.begin(), tiles.end());
+    for(int i = 0; i < current.size(); i++){
+        long long row = current[i] >> 32;
+        long long col = (int32_t)(uint32_t)current[i];
+        for(int dr = -1; dr <= 1; dr++)
+            for(int dc = -1; dc <= 1; dc++)
+                tiles.insert(tileKey(row + dr, col + dc));
+    }
+}
@@ -0,0 +1,83 @@
+// TiledMap.h
+
+// Planning against the part of a big map that a job actually uses.  The map file is split into
+// square tiles.  An index of which street records touch each tile is kept next to the file as
+// <map file>.tiles, or wherever the caller asks; the first open() builds it and later ones just
+// read it, for as long as the map file keeps the size and modification time it was built from.
+//
+// A plan starts from the tiles holding its depot and deliveries plus the ring of tiles around
+// them.  Whenever a leg's search expands a node in a tile that isn't loaded (see
+// StreetRoute::frontierNodes), or the loaded streets don't connect every stop, more tiles are
+// added and the plan is made again, so the loaded area never cuts a route short.  Parsed tiles
+// stay in a cache that holds at most maxCachedTiles and evicts the least recently used, so
+// later plans in the same area don't go back to the file.
+//
+// One TiledMap answers one plan at a time.
+
+#ifndef TILEDMAP_INCLUDED
+#define TILEDMAP_INCLUDED
+
+#include "provided.h"
+#include <fstream>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class TiledMap
+{
+public:
+    TiledMap(double tileDegrees = 0.01, int maxCachedTiles = 256);
+      // reads, or builds and saves, the tile index at indexFile (mapFile + ".tiles" if empty);
+      // false if mapFile can't be read
+    bool open(const std::string& mapFile, const std::string& indexFile = "");
+    DeliveryResult generateDeliveryPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        std::vector<DeliveryCommand>& commands,
+        double& totalDistanceTravelled);
+      // tiles with any streets in them, across the whole map
+    int tileCount() const;
+      // tiles the last plan ended up loading, and how many times it had to add tiles
+    int tilesLoaded() const;
+    int expansions() const;
+    int cachedTiles() const;
+      // the map the last plan was made on
+    const StreetMap* lastMap() const;
+    TiledMap(const TiledMap&) = delete;
+    TiledMap& operator=(const TiledMap&) = delete;
+private:
+    typedef long long TileKey;
+
+      // the map file's text for every street record touching one tile, keyed by file offset
+    struct Tile
+    {
+        std::vector<long> offsets;
+        std::vector<std::string> records;
+    };
+
+    double m_tileDegrees;
+    int m_maxCachedTiles;
+    std::string m_mapFile;
+    std::ifstream m_file;
+    std::unordered_map<TileKey, std::vector<long>> m_index;   // tile -> offsets of its records
+    std::list<TileKey> m_lru;                                  // most recently used first
+    std::unordered_map<TileKey, std::pair<std::shared_ptr<const Tile>, std::list<TileKey>::iterator>> m_cache;
+    std::unique_ptr<StreetMap> m_map;
+    int m_tilesLoaded;
+    int m_expansions;
+
+    TileKey tileOf(double lat, double lon) const;
+    TileKey tileOf(const GeoCoord& gc) const;
+    bool buildIndex(long fileSize);
+    bool readIndex(const std::string& indexFile, long fileSize, long long modified);
+    bool writeIndex(const std::string& indexFile, long fileSize, long long modified) const;
+    std::shared_ptr<const Tile> tile(TileKey key);
+    bool loadTiles(const std::unordered_set<TileKey>& tiles);
+    bool provablyDisconnected(const GeoCoord& depot, const std::vector<DeliveryRequest>& deliveries) const;
+    void addRing(std::unordered_set<TileKey>& tiles) const;
+};
+
+#endif // TILEDMAP_INCLUDED
@@ -0,0 +1,192 @@
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+static const int TRACE_BUFFER_EVENTS = 1 << 15;    // per thread, under 2MB
+
+// One thread's spans.  Only the owning thread writes; `written` counts every event ever
+// recorded, so the newest is at (written - 1) % size and, once it wraps, the oldest at written.
+struct TraceBuffer
+{
+    TraceBuffer(int threadId)
+     : events(TRACE_BUFFER_EVENTS), written(0), inUse(true), tid(threadId)
+    {}
+
+    vector<TraceEvent> events;
+    atomic<uint64_t> written;
+    atomic<bool> inUse;         // false once the owning thread has exited
+    int tid;
+};
+
+// Every buffer ever handed out.  A buffer outlives its thread so its spans can still be dumped,
+// and the next new thread takes it over, so a server starting threads all day doesn't grow.
+static mutex s_buffersMutex;
+static vector<unique_ptr<TraceBuffer>> s_buffers;
+
+static TraceBuffer* claimBuffer()
+{
+    lock_guard<mutex> lock(s_buffersMutex);
+    for (size_t i = 0; i < s_buffers.size(); i++)
+    {
+        bool wasInUse = false;
+        if (s_buffers[i]->inUse.compare_exchange_strong(wasInUse, true))
+            return s_buffers[i].get();
+    }
+    s_buffers.push_back(unique_ptr<TraceBuffer>(new TraceBuffer(s_buffers.size() + 1)));
+    return s_buffers.back().get();
+}
+
+// the calling thread's buffer, or null before its first span; a plain pointer, so reading it
+// needs no check that a thread_local object has been constructed
+static thread_local TraceBuffer* t_buffer = nullptr;
+
+// releases the thread's buffer when the thread exits
+struct TraceBufferHolder
+{
+    TraceBufferHolder()
+     : buffer(claimBuffer())
+    {}
+
+    ~TraceBufferHolder()
+    {
+        buffer->inUse = false;
+    }
+
+    TraceBuffer* buffer;
+};
+
+// a reading of both clocks from when the program started, so traceNow() ticks can be measured
+// against the steady clock when the trace is written
+struct TraceClockEpoch
+{
+    TraceClockEpoch()
+     : ticks(traceNow()), time(chrono::steady_clock::now())
+    {}
+
+    double nanosecondsPerTick() const
+    {
+#ifdef TRACE_USES_TSC
+        int64_t elapsedTicks = traceNow() - ticks;
+        double elapsedNanoseconds = chrono::duration<double, nano>(chrono::steady_clock::now() - time).count();
+        return elapsedTicks > 0 ? elapsedNanoseconds / elapsedTicks : 1;
+#else
+        return 1;
+#endif
+    }
+
+    int64_t ticks;
+    chrono::steady_clock::time_point time;
+};
+
+static TraceClockEpoch s_epoch;
+
+static TraceBuffer* claimThreadBuffer()
+{
+    static thread_local TraceBufferHolder holder;
+    t_buffer = holder.buffer;
+    return t_buffer;
+}
+
+void recordTraceEvent(const TraceEvent& e)
+{
+    TraceBuffer* b = t_buffer ? t_buffer : claimThreadBuffer();
+    uint64_t n = b->written.load(memory_order_relaxed);
+    b->events[n % TRACE_BUFFER_EVENTS] = e;
+    b->written.store(n + 1, memory_order_release);
+}
+
+bool traceEnabled()
+{
+#ifdef PLAN_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+// s as a JSON string, quotes included
+static void writeJsonString(ostream& out, const char* s)
+{
+    out << '"';
+    for (; *s; s++)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        }
+        else
+            out << c;
+    }
+    out << '"';
+}
+
+// Complete ("X") events, times in microseconds from the earliest span kept, with each
+// span's counters as its args.
+bool writeTraceJson(ostream& out)
+{
+    lock_guard<mutex> lock(s_buffersMutex);
+    double scale = s_epoch.nanosecondsPerTick() / 1000;
+    int64_t origin = INT64_MAX;
+    for (size_t i = 0; i < s_buffers.size(); i++)
+    {
+        const TraceBuffer& b = *s_buffers[i];
+        uint64_t n = b.written.load(memory_order_acquire);
+        for (uint64_t k = n > TRACE_BUFFER_EVENTS ? n - TRACE_BUFFER_EVENTS : 0; k < n; k++)
+            origin = min(origin, b.events[k % TRACE_BUFFER_EVENTS].start);
+    }
+
+    out << "{\"traceEvents\": [";
+    bool first = true;
+    char number[32];
+    for (size_t i = 0; i < s_buffers.size(); i++)
+    {
+        const TraceBuffer& b = *s_buffers[i];
+        uint64_t n = b.written.load(memory_order_acquire);
+        for (uint64_t k = n > TRACE_BUFFER_EVENTS ? n - TRACE_BUFFER_EVENTS : 0; k < n; k++)
+        {
+            const TraceEvent& e = b.events[k % TRACE_BUFFER_EVENTS];
+            out << (first ? "\n" : ",\n") << "{\"name\": ";
+            writeJsonString(out, e.name);
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << b.tid;
+            snprintf(number, sizeof(number), "%.3f", (e.start - origin) * scale);
+            out << ", \"ts\": " << number;
+            snprintf(number, sizeof(number), "%.3f", e.duration * scale);
+            out << ", \"dur\": " << number;
+            if (e.keys[0])
+            {
+                out << ", \"args\": {";
+                writeJsonString(out, e.keys[0]);
+                out << ": " << e.values[0];
+                if (e.keys[1])
+                {
+                    out << ", ";
+                    writeJsonString(out, e.keys[1]);
+                    out << ": " << e.values[1];
+                }
+                out << "}";
+            }
+            out << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return bool(out);
+}
+
+void clearTrace()
+{
+    lock_guard<mutex> lock(s_buffersMutex);
+    for (size_t i = 0; i < s_buffers.size(); i++)
+        s_buffers[i]->written = 0;
+}
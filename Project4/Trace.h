@@ -0,0 +1,104 @@
+// Trace.h
+
+// Optional tracing of where a plan's time goes.  Build with -DPLAN_TRACE to turn it on;
+// otherwise TRACE_SPAN and TRACE_COUNT expand to nothing, the way ROUTER_STAT does.
+//
+//     TRACE_SPAN(span, "route leg");       times the rest of the enclosing scope
+//     TRACE_COUNT(span, "edges", n);       attaches a number to it, at most two per span
+//
+// Names and keys must outlive the trace, which string literals do; writeTraceJson escapes them.
+// Spans nest by time, so a span opened inside another shows up beneath it.  A finished span
+// goes into a fixed-size ring buffer owned by the thread that ran it, so recording takes no lock
+// and allocates nothing.  A span costs two traceNow() reads plus a few nanoseconds to record;
+// where reading the time stamp counter is slow, as under some hypervisors, the reads dominate.  When a buffer is full its
+// oldest spans are overwritten.  writeTraceJson merges every thread's buffer into Chrome
+// trace-event JSON, which chrome://tracing and Perfetto open.  Call it, or clearTrace, only
+// while nothing traced is running.
+
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <x86intrin.h>
+#define TRACE_USES_TSC
+#endif
+
+#ifdef PLAN_TRACE
+#define TRACE_SPAN(var, name) TraceSpan var(name)
+#define TRACE_COUNT(var, key, value) var.count(key, value)
+#else
+#define TRACE_SPAN(var, name)
+#define TRACE_COUNT(var, key, value)
+#endif
+
+struct TraceEvent
+{
+    const char* name;
+    const char* keys[2];    // nullptr where unused
+    long values[2];
+    int64_t start;          // traceNow() ticks
+    int64_t duration;
+};
+
+  // The time stamp counter where there is one: it reads in a fraction of the time the steady
+  // clock takes, and writeTraceJson converts its ticks to time.
+inline int64_t traceNow()
+{
+#ifdef TRACE_USES_TSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+  // appends e to the calling thread's ring buffer
+void recordTraceEvent(const TraceEvent& e);
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name)
+    {
+        m_event.name = name;
+        m_event.keys[0] = m_event.keys[1] = nullptr;
+        m_event.start = traceNow();
+    }
+
+    ~TraceSpan()
+    {
+        m_event.duration = traceNow() - m_event.start;
+        recordTraceEvent(m_event);
+    }
+
+      // sets key's value, replacing an earlier one with the same key; a third key is dropped
+    void count(const char* key, long value)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            if (m_event.keys[i] == nullptr || m_event.keys[i] == key)
+            {
+                m_event.keys[i] = key;
+                m_event.values[i] = value;
+                return;
+            }
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+private:
+    TraceEvent m_event;
+};
+
+  // whether this build was made with PLAN_TRACE
+bool traceEnabled();
+
+bool writeTraceJson(std::ostream& out);
+
+  // forgets every span recorded so far
+void clearTrace();
+
+#endif // TRACE_INCLUDED
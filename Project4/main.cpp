@@ -1,19 +1,18 @@
 #include "provided.h"
+#include "DeliveryIO.h"
+#include "Trace.h"
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <string>
 #include <vector>
 using namespace std;
 
-bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v);
-bool parseDelivery(string line, string& lat, string& lon, string& item);
-
 int main(int argc, char *argv[])
 {
-    if (argc != 3)
+    // the optional third argument is where to write a trace of the run (see Trace.h)
+    if (argc != 3 && argc != 4)
     {
-        cout << "Usage: " << argv[0] << " mapdata.txt deliveries.txt" << endl;
+        cout << "Usage: " << argv[0] << " mapdata.txt deliveries.txt [trace.json]" << endl;
         return 1;
     }
 
@@ -39,64 +38,18 @@ int main(int argc, char *argv[])
     vector<DeliveryCommand> dcs;
     double totalMiles;
     DeliveryResult result = dp.generateDeliveryPlan(depot, deliveries, dcs, totalMiles);
-    if (result == BAD_COORD)
-    {
-        cout << "One or more depot or delivery coordinates are invalid." << endl;
-        return 1;
-    }
-    if (result == NO_ROUTE)
-    {
-        cout << "No route can be found to deliver all items." << endl;
+    if (!writeDeliveryPlan(cout, result, dcs, totalMiles))
         return 1;
-    }
-    cout << "Starting at the depot...\n";
-    for (const auto& dc : dcs)
-        cout << dc.description() << endl;
-    cout << "You are back at the depot and your deliveries are done!\n";
-    cout.setf(ios::fixed);
-    cout.precision(2);
-    cout << totalMiles << " miles travelled for all deliveries." << endl;
-}
 
-bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v)
-{
-    ifstream inf(deliveriesFile);
-    if (!inf)
-        return false;
-    string lat;
-    string lon;
-    inf >> lat >> lon;
-    inf.ignore(10000, '\n');
-    depot = GeoCoord(lat, lon);
-    string line;
-    while (getline(inf, line))
-    {
-        string item;
-        if (parseDelivery(line, lat, lon, item))
-            v.push_back(DeliveryRequest(item, GeoCoord(lat, lon)));
-    }
-    return true;
-}
-
-bool parseDelivery(string line, string& lat, string& lon, string& item)
-{
-    const size_t colon = line.find(':');
-    if (colon == string::npos)
-    {
-        cout << "Missing colon in deliveries file line: " << line << endl;
-        return false;
-    }
-    istringstream iss(line.substr(0, colon));
-    if (!(iss >> lat >> lon))
-    {
-        cout << "Bad format in deliveries file line: " << line << endl;
-        return false;
-    }
-    item = line.substr(colon + 1);
-    if (item.empty())
+    if (argc == 4)
     {
-        cout << "Missing item in deliveries file line: " << line << endl;
-        return false;
+        if (!traceEnabled())
+            cerr << "This build doesn't record traces; rebuild with -DPLAN_TRACE" << endl;
+        ofstream traceFile(argv[3]);
+        if (!writeTraceJson(traceFile))
+        {
+            cerr << "Unable to write trace file " << argv[3] << endl;
+            return 1;
+        }
     }
-    return true;
 }
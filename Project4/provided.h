@@ -8,10 +8,12 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <functional>
+#include <cstdio>
 
 enum DeliveryResult
 {
-    DELIVERY_SUCCESS, NO_ROUTE, BAD_COORD
+    DELIVERY_SUCCESS, NO_ROUTE, BAD_COORD, OVER_CAPACITY
 };
 
 struct GeoCoord
@@ -73,13 +75,90 @@ bool operator==(const StreetSegment& lhs, const StreetSegment& rhs)
 
 class StreetMapImpl;
 
+  // Bytes a loaded map holds, by part.  Containers are counted by capacity and allocator
+  // overhead is left out, so the total is a floor under the RSS they cost.
+struct MapMemoryReport
+{
+    size_t nodeIndex;       // coordinate -> node id hash map, including its copies of the coordinates
+    size_t coordinates;     // node id -> coordinate, component, frontier flag and file order
+    size_t adjacency;       // the edges leaving each node
+    size_t edges;
+    size_t turns;           // turn classes of consecutive edges
+    size_t names;           // the street name index
+    size_t strings;         // the command string table: the street names of every map loaded so far
+    size_t searchScratch;   // every thread's router search state, shared by all maps
+
+    size_t total() const
+    {
+        return nodeIndex + coordinates + adjacency + edges + turns + names + strings + searchScratch;
+    }
+};
+
 class StreetMap
 {
 public:
     StreetMap();
     ~StreetMap();
     bool load(std::string mapFile);
+      // Same, reading the map file's format from in.  Either one replaces whatever an earlier
+      // load put in this map.
+    bool load(std::istream& in);
     bool getSegmentsThatStartWith(const GeoCoord& gc, std::vector<StreetSegment>& segs) const;
+      // Two coordinates are connected by some route iff they share a component id.
+    bool getComponentOf(const GeoCoord& gc, int& componentId) const;
+      // Integer view of the same graph.  Each segment in the map file becomes two directed
+      // edges; ids run from 0 to edgeCount()-1 and stay valid until the next load.
+    int edgeCount() const;
+    bool getEdgesThatStartWith(const GeoCoord& gc, std::vector<int>& edgeIds) const;
+    bool getSegment(int edgeId, StreetSegment& seg) const;
+    const GeoCoord& edgeStart(int edgeId) const;
+    const GeoCoord& edgeEnd(int edgeId) const;
+    double edgeLength(int edgeId) const;
+    const std::string& edgeName(int edgeId) const;
+      // the street name's id in the command string table
+    int edgeNameId(int edgeId) const;
+      // Nodes are the distinct coordinates segments start or end at, with ids from 0 to
+      // nodeCount()-1, so searches can keep their state in plain arrays.
+    int nodeCount() const;
+    bool getNodeId(const GeoCoord& gc, int& nodeId) const;
+    const GeoCoord& nodeCoord(int nodeId) const;
+    int nodeComponent(int nodeId) const;
+    const std::vector<int>& edgesFrom(int nodeId) const;
+    int edgeFrom(int edgeId) const;
+    int edgeTo(int edgeId) const;
+      // How a driver turns going from one edge onto the next, by angleBetween2Lines: within
+      // 30 degrees of straight on, a left, a right, or within 30 degrees of doubling back.
+    enum TurnClass { TURN_STRAIGHT, TURN_LEFT, TURN_RIGHT, TURN_U };
+      // The turn from fromEdge onto edgesFrom(edgeTo(fromEdge))[k]; every pair is classified
+      // once at load, so searches that charge for turns never compute an angle.
+    TurnClass turnClass(int fromEdge, int k) const;
+      // Street names, matched ignoring case.  The name ids (see edgeNameId) of the streets whose
+      // names start with prefix, in alphabetical order; false if there are none.
+    bool findStreets(const std::string& prefix, std::vector<int>& nameIds) const;
+      // every edge, in both directions, of the street with that name id
+    bool getStreetEdges(int nameId, std::vector<int>& edgeIds) const;
+      // Nodes where two streets meet, given as name prefixes joined by '&', like "Weyburn &
+      // Westwood"; false if there is no such node.
+    bool findIntersections(const std::string& streets, std::vector<int>& nodeIds) const;
+      // How node ids are laid out.  Loading numbers nodes in the order the map file first
+      // mentions them.  Hilbert order follows a space-filling curve over the coordinates, and
+      // BFS order walks each component breadth first, so either way nodes near each other on
+      // the map are near each other in memory and a search touches fewer cache lines.
+    enum NodeOrder { ORDER_FILE, ORDER_HILBERT, ORDER_BFS };
+      // Renumbers nodes, and edges to match (each node's edges get consecutive ids, in the same
+      // order as before), then rebuilds every array in the new order.  The result depends only
+      // on the map's contents, so the same map file and order always give the same ids.  Call
+      // it after load, before any other thread uses the map; ids from before are invalid.  The
+      // order isn't saved anywhere, so each load that wants it reorders again.
+    void reorderNodes(NodeOrder order);
+    NodeOrder nodeOrder() const;
+    MapMemoryReport memoryReport() const;
+      // For a map loaded from part of a bigger one (see TiledMap.h): nodes where outside(coord)
+      // holds are the frontier, since some of their streets may not have been loaded.  A
+      // search that expands one lists it in StreetRoute::frontierNodes.  Maps loaded whole have
+      // no frontier.
+    void markFrontier(const std::function<bool(const GeoCoord&)>& outside);
+    bool isFrontier(int nodeId) const;
       // We prevent a StreetMap object from being copied or assigned.
     StreetMap(const StreetMap&) = delete;
     StreetMap& operator=(const StreetMap&) = delete;
@@ -88,6 +167,106 @@ private:
 };
 
 class PointToPointRouterImpl;
+struct RouteQueryStats;
+
+  // A route as the contiguous sequence of directed edge ids it follows.  StreetSegments are only
+  // built when asked for, and clearing keeps the buffer, so reusing one StreetRoute across
+  // queries stops allocating once it has grown to the longest route.
+class StreetRoute
+{
+public:
+    StreetRoute()
+     : m_sm(nullptr), m_distance(0)
+    {}
+
+    void clear()
+    {
+        m_edges.clear();
+        m_frontier.clear();
+        m_distance = 0;
+    }
+
+    void reserve(int numEdges)
+    {
+        m_edges.reserve(numEdges);
+    }
+
+    int size() const
+    {
+        return m_edges.size();
+    }
+
+    bool empty() const
+    {
+        return m_edges.empty();
+    }
+
+    int edgeId(int i) const
+    {
+        return m_edges[i];
+    }
+
+    const std::vector<int>& edgeIds() const
+    {
+        return m_edges;
+    }
+
+    double distance() const
+    {
+        return m_distance;
+    }
+
+    StreetSegment segment(int i) const
+    {
+        StreetSegment seg;
+        m_sm->getSegment(m_edges[i], seg);
+        return seg;
+    }
+
+      // the route's size()+1 points: where the first edge starts, then where each edge ends
+    const GeoCoord& point(int i) const
+    {
+        return i == 0 ? m_sm->edgeStart(m_edges[0]) : m_sm->edgeEnd(m_edges[i - 1]);
+    }
+
+      // Frontier nodes (see StreetMap::markFrontier) the search for this route expanded.  If
+      // there are any, the whole map might have a shorter route through streets not loaded.
+    const std::vector<int>& frontierNodes() const
+    {
+        return m_frontier;
+    }
+
+      // appends the materialized segments, for callers that still want the list form
+    void appendSegments(std::list<StreetSegment>& route) const
+    {
+        for (size_t i = 0; i < m_edges.size(); i++)
+            route.push_back(segment(i));
+    }
+
+private:
+    friend class PointToPointRouterImpl;
+    const StreetMap* m_sm;
+    std::vector<int> m_edges;
+    std::vector<int> m_frontier;
+    double           m_distance;
+};
+
+  // What can be driven within some number of miles of a start: the directed edges reachable end
+  // to end, and the boundary edges the limit runs out partway along, with how many of their
+  // miles are still inside it.
+struct ServiceArea
+{
+    std::vector<int>    edges;
+    std::vector<int>    boundaryEdges;
+    std::vector<double> boundaryMiles;
+
+    void clear()
+    {
+        edges.clear();
+        boundaryEdges.clear();
+        boundaryMiles.clear();
+    }
+};
 
 class PointToPointRouter
 {
@@ -99,6 +278,46 @@ public:
         const GeoCoord& end,
         std::list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+      // Same as above, also filling in *stats (see RouterStats.h) when built with ROUTER_STATS.
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        std::list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        RouteQueryStats* stats) const;
+      // Fills route with edge ids instead of StreetSegments; see StreetRoute.
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        StreetRoute& route,
+        double& totalDistanceTravelled,
+        RouteQueryStats* stats = nullptr) const;
+      // Road distance in miles from start to each of targets, in one search.  Targets in a
+      // different part of the map from start get -1.
+    DeliveryResult generateDistancesFrom(
+        const GeoCoord& start,
+        const std::vector<GeoCoord>& targets,
+        std::vector<double>& distances) const;
+      // Everything within maxMiles of road distance from start, by one search that stops at the
+      // limit instead of a route per street.
+    DeliveryResult generateServiceArea(
+        const GeoCoord& start,
+        double maxMiles,
+        ServiceArea& area) const;
+      // One area per depot, searched in parallel on the shared thread pool.  BAD_COORD, with
+      // no areas filled in, if any depot isn't on the map.
+    DeliveryResult generateServiceAreas(
+        const std::vector<GeoCoord>& depots,
+        double maxMiles,
+        std::vector<ServiceArea>& areas) const;
+      // Writes the totals and latency histogram over every query answered so far.
+    void exportStats(std::ostream& out) const;
+      // Makes routes minimize length plus a penalty in miles for each left, right and U-turn
+      // (see StreetMap::TurnClass) instead of length alone.  All zero, the default, keeps the
+      // plain shortest-path search.  A negative penalty counts as 0, since a turn can't shorten
+      // a route.  Distances reported are still the miles driven.  Set this before sharing the
+      // router between threads.
+    void setTurnPenalties(double left, double right, double uTurn);
       // We prevent a PointToPointRouter object from being copied or assigned.
     PointToPointRouter(const PointToPointRouter&) = delete;
     PointToPointRouter& operator=(const PointToPointRouter&) = delete;
@@ -127,6 +346,29 @@ public:
         std::vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+      // Same, but ordering by roadDistances instead of crow distance.  roadDistances[i][j] is
+      // the distance from stop i to stop j, where stop 0 is the depot and stop k is
+      // deliveries[k-1] as passed in.  The reported distances are still crow distances.
+    void optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        std::vector<DeliveryRequest>& deliveries,
+        const std::vector<std::vector<double>>& roadDistances,
+        double& oldCrowDistance,
+        double& newCrowDistance) const;
+      // Keeps improving the order on numThreads threads (0 = one per core) until
+      // timeBudgetSeconds have passed, then leaves the best order found in deliveries.
+    void optimizeDeliveryOrderWithin(
+        const GeoCoord& depot,
+        std::vector<DeliveryRequest>& deliveries,
+        double timeBudgetSeconds,
+        int numThreads,
+        double& oldCrowDistance,
+        double& newCrowDistance) const;
+      // Batches of at most maxStops deliveries (default 16, capped at 20) are ordered by an
+      // exact solver, larger ones heuristically.  0 or less always uses the heuristic.
+    void setExactSolverThreshold(int maxStops);
+      // Threads the exact solver may use per subset layer (default 1).
+    void setExactSolverThreads(int numThreads);
       // We prevent a DeliveryOptimizer object from being copied or assigned.
     DeliveryOptimizer(const DeliveryOptimizer&) = delete;
     DeliveryOptimizer& operator=(const DeliveryOptimizer&) = delete;
@@ -134,18 +376,61 @@ private:
     DeliveryOptimizerImpl* m_impl;
 };
 
+  // Process-wide table of the street names DeliveryCommands refer to.  Ids are dense from 0 and
+  // a string keeps its id for the life of the process, so the table only grows by the number of
+  // distinct street names in the maps loaded.  Looking a string up by id never locks.
+int internCommandString(const std::string& s);
+const std::string& commandString(int id);
+
+  // A compact command: 16 bytes, with the direction as an enum and the street as an id into the
+  // command string table, so copying one never allocates.  A Deliver command's item is request
+  // data rather than map data, so instead of being interned it is held by the command itself,
+  // shared between its copies and freed with the last of them.
 class DeliveryCommand
 {
 public:
+    enum Direction : unsigned char
+    {
+        EAST, NORTHEAST, NORTH, NORTHWEST, WEST, SOUTHWEST, SOUTH, SOUTHEAST, LEFT, RIGHT,
+        NO_DIRECTION
+    };
+
     DeliveryCommand()
-     : m_type(INVALID)
+     : m_type(INVALID), m_direction(NO_DIRECTION), m_name(-1), m_distance(0)
     {}
 
+    DeliveryCommand(const DeliveryCommand& other)
+     : m_type(INVALID), m_direction(NO_DIRECTION), m_name(-1), m_distance(0)
+    {
+        copyFrom(other);
+    }
+
+    DeliveryCommand& operator=(const DeliveryCommand& other)
+    {
+        if (this != &other)
+        {
+            release();
+            copyFrom(other);
+        }
+        return *this;
+    }
+
+    ~DeliveryCommand()
+    {
+        release();
+    }
+
       // make this DeliveryCommand a Proceed command
     void initAsProceedCommand(std::string dir, std::string streetName, double dist)
     {
+        initAsProceedCommand(directionFor(dir), internCommandString(streetName), dist);
+    }
+
+    void initAsProceedCommand(Direction dir, int streetNameId, double dist)
+    {
+        release();
         m_type = PROCEED;
-        m_streetName = streetName;
+        m_name = streetNameId;
         m_direction = dir;
         m_distance = dist;
     }
@@ -153,8 +438,14 @@ public:
       // make this DeliveryCommand a Turn command
     void initAsTurnCommand(std::string dir, std::string streetName)
     {
+        initAsTurnCommand(directionFor(dir), internCommandString(streetName));
+    }
+
+    void initAsTurnCommand(Direction dir, int streetNameId)
+    {
+        release();
         m_type = TURN;
-        m_streetName = streetName;
+        m_name = streetNameId;
         m_direction = dir;
         m_distance = 0;
     }
@@ -162,50 +453,136 @@ public:
       // make this DeliveryCommand a Deliver command
     void initAsDeliverCommand(std::string item)
     {
+        release();
         m_type = DELIVER;
-        m_item = item;
+        m_direction = NO_DIRECTION;
+        m_name = -1;
+        m_item = newItemText(std::move(item));
     }
 
     void increaseDistance(double byThisMuch)
     {
-        m_distance += byThisMuch;
+        if (m_type != DELIVER)
+            m_distance += byThisMuch;
     }
 
     std::string streetName() const
     {
-        return m_streetName;
+        if (m_type == DELIVER || m_name < 0)
+            return "";
+        return commandString(m_name);
     }
 
-    std::string description() const
+      // Appends the same text description() returns to out.  Once out has grown to fit, this
+      // allocates nothing, so a batch of commands can be formatted into one reused buffer.
+    void appendDescription(std::string& out) const
     {
-        std::ostringstream oss;
         switch (m_type)
         {
           case INVALID:
-            oss << "<invalid>";
+            out += "<invalid>";
             break;
           case TURN:
-            oss << "Turn " << m_direction << " on " << m_streetName;
+            out += "Turn ";
+            out += directionName(m_direction);
+            out += " on ";
+            out += commandString(m_name);
             break;
           case PROCEED:
-            oss.setf(std::ios::fixed);
-            oss.precision(2);
-            oss << "Proceed " << m_direction << " on " << m_streetName << " for " << m_distance << " miles";
+          {
+            char miles[32];
+            std::snprintf(miles, sizeof(miles), "%.2f", m_distance);
+            out += "Proceed ";
+            out += directionName(m_direction);
+            out += " on ";
+            out += commandString(m_name);
+            out += " for ";
+            out += miles;
+            out += " miles";
             break;
+          }
           case DELIVER:
-            oss << "DELIVER " << m_item;
+            out += "DELIVER ";
+            out += itemText(m_item);
             break;
         }
-        return oss.str();
+    }
+
+    std::string description() const
+    {
+        std::string text;
+        appendDescription(text);
+        return text;
+    }
+
+    static const char* directionName(Direction dir)
+    {
+        static const char* const names[] = {
+            "east", "northeast", "north", "northwest", "west", "southwest", "south", "southeast",
+            "left", "right", ""
+        };
+        return names[dir];
+    }
+
+    static Direction directionFor(const std::string& name)
+    {
+        for (int d = EAST; d < NO_DIRECTION; d++)
+        {
+            if (name == directionName(Direction(d)))
+                return Direction(d);
+        }
+        return NO_DIRECTION;
     }
 
 private:
-    enum CommandType { INVALID, PROCEED, TURN, DELIVER };
+    enum CommandType : unsigned char { INVALID, PROCEED, TURN, DELIVER };
+
+      // the item of a Deliver command, shared by its copies (DeliveryCommand.cpp)
+    struct ItemText;
+    static ItemText* newItemText(std::string item);
+    static void retainItemText(ItemText* item);
+    static void releaseItemText(ItemText* item);
+    static const std::string& itemText(const ItemText* item);
+
     CommandType m_type;        // turn left, turn right, proceed
-    std::string  m_streetName;  // Westwood Blvd
-    std::string  m_direction;   // "left" for turn or "northeast" for proceed
-    std::string  m_item;        // Item to deliver
-    double       m_distance;    // 1.92 (in miles)
+    Direction   m_direction;   // LEFT for turn or NORTHEAST for proceed
+    int         m_name;        // street (Westwood Blvd) in the command string table
+    union
+    {
+        double    m_distance;  // 1.92 (in miles)
+        ItemText* m_item;      // Sushi, for a Deliver command, which travels no distance
+    };
+
+    void copyFrom(const DeliveryCommand& other)
+    {
+        m_type = other.m_type;
+        m_direction = other.m_direction;
+        m_name = other.m_name;
+        if (m_type == DELIVER)
+        {
+            m_item = other.m_item;
+            retainItemText(m_item);
+        }
+        else
+            m_distance = other.m_distance;
+    }
+
+    void release()
+    {
+        if (m_type == DELIVER)
+            releaseItemText(m_item);
+        m_type = INVALID;
+        m_distance = 0;
+    }
+};
+
+  // One vehicle's share of a fleet plan.
+struct VehiclePlan
+{
+    int depot;                                  // index into the depots the plan was made for
+    std::vector<DeliveryRequest> deliveries;    // in the order they are made
+    std::vector<DeliveryCommand> commands;
+    double distanceTravelled;
 };
 
 class DeliveryPlannerImpl;
@@ -220,6 +597,27 @@ public:
         const std::vector<DeliveryRequest>& deliveries,
         std::vector<DeliveryCommand>& commands,
         double& totalDistanceTravelled) const;
+      // Same, also handing back the route of every leg in order, the last one being the
+      // return to the depot, for exporting the geometry (see RouteGeometry.h).
+    DeliveryResult generateDeliveryPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        std::vector<DeliveryCommand>& commands,
+        double& totalDistanceTravelled,
+        std::vector<StreetRoute>& legRoutes) const;
+      // Splits deliveries across at most numVehicles vehicles, each leaving from and returning
+      // to one of depots with at most vehicleCapacity deliveries aboard, and plans every
+      // vehicle's route.  Returns OVER_CAPACITY if the fleet can't carry every delivery.
+    DeliveryResult generateFleetPlan(
+        const std::vector<GeoCoord>& depots,
+        const std::vector<DeliveryRequest>& deliveries,
+        int numVehicles,
+        int vehicleCapacity,
+        std::vector<VehiclePlan>& plans,
+        double& totalDistanceTravelled) const;
+      // Routes each leg with turn penalties; see PointToPointRouter::setTurnPenalties.  Stop
+      // order is still chosen on distance alone.
+    void setTurnPenalties(double left, double right, double uTurn);
       // We prevent a DeliveryPlanner object from being copied or assigned.
     DeliveryPlanner(const DeliveryPlanner&) = delete;
     DeliveryPlanner& operator=(const DeliveryPlanner&) = delete;
@@ -227,6 +625,48 @@ private:
     DeliveryPlannerImpl* m_impl;
 };
 
+  // How a plan's command list changed: the `removed` commands starting at index `first` were
+  // replaced by `inserted`.
+struct DeliveryCommandDiff
+{
+    int first;
+    int removed;
+    std::vector<DeliveryCommand> inserted;
+};
+
+class IncrementalPlannerImpl;
+
+  // A delivery plan that stays open for orders arriving after it was made.  Each new
+  // delivery goes where it adds the least crow distance, and only the leg it splits is
+  // re-routed; every other leg's cached route and commands are kept.
+class IncrementalPlanner
+{
+public:
+    IncrementalPlanner(const StreetMap* sm);
+    ~IncrementalPlanner();
+      // Plans the initial batch the same way DeliveryPlanner::generateDeliveryPlan does.
+    DeliveryResult startPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        std::vector<DeliveryCommand>& commands,
+        double& totalDistanceTravelled);
+      // Inserts one more delivery.  On failure the plan is left unchanged.
+    DeliveryResult addDelivery(
+        const DeliveryRequest& delivery,
+        DeliveryCommandDiff& diff,
+        double& totalDistanceTravelled);
+      // The courier has made the first numDelivered deliveries, so new ones go after them.
+    void markDelivered(int numDelivered);
+    const std::vector<DeliveryRequest>& deliveries() const;
+    void getCommands(std::vector<DeliveryCommand>& commands) const;
+    double totalDistanceTravelled() const;
+      // We prevent an IncrementalPlanner object from being copied or assigned.
+    IncrementalPlanner(const IncrementalPlanner&) = delete;
+    IncrementalPlanner& operator=(const IncrementalPlanner&) = delete;
+private:
+    IncrementalPlannerImpl* m_impl;
+};
+
 // Tools for computing distance between GeoCoords, angle of a StreetSegment,
 // and angle between two StreetSegments
 
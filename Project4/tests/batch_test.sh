@@ -0,0 +1,40 @@
+#!/bin/sh
+# tests/batch_test.sh
+
+# A job whose coordinates aren't numbers must fail on its own, as BAD_COORD, while the rest of
+# the batch is planned and written as usual.
+#
+#     sh tests/batch_test.sh path/to/BatchMain mapdata.txt
+
+batch=$1
+map=$2
+if [ -z "$batch" ] || [ -z "$map" ]; then
+    echo "Usage: $0 BatchMain mapdata.txt"
+    exit 2
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+mkdir "$work/jobs" "$work/out"
+printf '34.0625329 -118.4470263\n34.0636671 -118.4461842:Chicken tenders\n' > "$work/jobs/a_good"
+printf 'x y\n34.0636671 -118.4461842:Chicken tenders\n' > "$work/jobs/b_bad_depot"
+printf '34.0625329 -118.4470263\nabc def:Pizza\n' > "$work/jobs/c_bad_delivery"
+printf '34.0625329 -118.4470263\n34.0636671 -118.4461842:Beer\n' > "$work/jobs/d_good"
+
+fail() {
+    echo "FAIL: $1"
+    cat "$work/summary"
+    exit 1
+}
+
+"$batch" "$map" "$work/jobs" "$work/out" > "$work/summary"
+status=$?
+[ $status -eq 2 ] || fail "BatchMain exited with status $status, not 2 for failed jobs"
+grep -q "a_good OK " "$work/summary" || fail "a_good wasn't planned"
+grep -q "b_bad_depot BAD_COORD " "$work/summary" || fail "b_bad_depot wasn't BAD_COORD"
+grep -q "c_bad_delivery BAD_COORD " "$work/summary" || fail "c_bad_delivery wasn't BAD_COORD"
+grep -q "d_good OK " "$work/summary" || fail "d_good wasn't planned"
+grep -q "jobs 4, failed 2" "$work/summary" || fail "summary doesn't count two failures"
+grep -q "DELIVER Beer" "$work/out/d_good.out" || fail "d_good.out has no plan"
+grep -q "coordinates are invalid" "$work/out/b_bad_depot.out" || fail "b_bad_depot.out has no BAD_COORD message"
+echo "PASS"
@@ -0,0 +1,32 @@
+#!/bin/sh
+# tests/plan_server_test.sh
+
+# A request whose coordinates aren't numbers must get the BAD_COORD answer, and the server must
+# go on to answer the next request on the same connection.
+#
+#     sh tests/plan_server_test.sh path/to/PlanServer mapdata.txt
+
+server=$1
+map=$2
+if [ -z "$server" ] || [ -z "$map" ]; then
+    echo "Usage: $0 PlanServer mapdata.txt"
+    exit 2
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+fail() {
+    echo "FAIL: $1"
+    cat "$work/responses"
+    exit 1
+}
+
+printf 'hello\n\n34.0625329 -118.4470263\nabc def:Pizza\n\n34.0625329 -118.4470263\n34.0636671 -118.4461842:Beer\n\n' |
+    "$server" "$map" --stdin > "$work/responses"
+status=$?
+[ $status -eq 0 ] || fail "PlanServer exited with status $status"
+[ "$(grep -c "coordinates are invalid" "$work/responses")" -eq 2 ] || fail "the two bad requests weren't both BAD_COORD"
+grep -q "DELIVER Beer" "$work/responses" || fail "the good request after them wasn't planned"
+[ "$(tail -n 3 "$work/responses" | head -n 1 | cut -c1-20)" = "You are back at the " ] || fail "the good request wasn't answered last"
+echo "PASS"